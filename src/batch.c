@@ -0,0 +1,198 @@
+#include "batch.h"
+#include "slide.h"
+#include <string.h>
+
+#define BATCH_ARRAYS 8
+#define BATCH_ALIGNMENT 32
+
+int request_batch_new(request_batch_t *batch, int64_t n) {
+  memset(batch, 0, sizeof(request_batch_t));
+  // Each array padded to the alignment
+  int64_t stride = (MAX(n, 1) * 8 + BATCH_ALIGNMENT - 1) / BATCH_ALIGNMENT *
+                   BATCH_ALIGNMENT;
+  if (posix_memalign(&batch->data, BATCH_ALIGNMENT, BATCH_ARRAYS * stride)) {
+    batch->data = NULL;
+    return 1;
+  }
+  char *data = batch->data;
+  batch->n = n;
+  batch->x = (int64_t *)(data + 0 * stride);
+  batch->y = (int64_t *)(data + 1 * stride);
+  batch->location_x = (int64_t *)(data + 2 * stride);
+  batch->location_y = (int64_t *)(data + 3 * stride);
+  batch->size_x = (int64_t *)(data + 4 * stride);
+  batch->size_y = (int64_t *)(data + 5 * stride);
+  batch->fractional_x = (double *)(data + 6 * stride);
+  batch->fractional_y = (double *)(data + 7 * stride);
+  return 0;
+}
+
+void request_batch_free(request_batch_t *batch) {
+  free(batch->data);
+  memset(batch, 0, sizeof(request_batch_t));
+}
+
+// One axis of native_region_request, same operations in the same order
+static inline void native_axis(double location, double size,
+                               int64_t level_size, double scaling,
+                               double downsample, double extra,
+                               int64_t *level0, int64_t *native_size,
+                               double *fractional) {
+  double native_location = location / scaling;
+  double native_extent = native_location + size / scaling;
+  int64_t left = floor(native_location - extra);
+  left = MIN(MAX(left, 0), level_size);
+  int64_t l0 = floor((double)left * downsample);
+  double dleft = (double)l0 / downsample;
+  int64_t right = ceil(native_extent + extra);
+  right = MIN(MAX(right, 0), level_size);
+  *level0 = l0;
+  *native_size = ceil((double)right - dleft);
+  *fractional = native_location - dleft;
+}
+
+void native_region_requests_soa_scalar(request_batch_t *batch, ipos_t size,
+                                       native_level_t native_level) {
+  batch->level = native_level.level;
+  batch->native_size = _div(_double(size), native_level.scaling);
+  for (int64_t i = 0; i < batch->n; i++) {
+    native_axis(batch->x[i], size.x, native_level.size.x, native_level.scaling,
+                native_level.downsample, native_level.extra_pixels,
+                &batch->location_x[i], &batch->size_x[i],
+                &batch->fractional_x[i]);
+    native_axis(batch->y[i], size.y, native_level.size.y, native_level.scaling,
+                native_level.downsample, native_level.extra_pixels,
+                &batch->location_y[i], &batch->size_y[i],
+                &batch->fractional_y[i]);
+  }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_SIMD 1
+#include <immintrin.h>
+
+// int64 <-> double for 0 <= v < 2^51: add / remove 2^52 as bits
+#define BATCH_MAGIC 4503599627370496.0
+
+__attribute__((target("avx2"))) static inline __m256d
+int2double(__m256i v) {
+  const __m256d magic = _mm256_set1_pd(BATCH_MAGIC);
+  return _mm256_sub_pd(
+      _mm256_castsi256_pd(_mm256_or_si256(v, _mm256_castpd_si256(magic))),
+      magic);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+double2int(__m256d v) {
+  const __m256d magic = _mm256_set1_pd(BATCH_MAGIC);
+  return _mm256_xor_si256(_mm256_castpd_si256(_mm256_add_pd(v, magic)),
+                          _mm256_castpd_si256(magic));
+}
+
+// native_axis, 4 tiles at a time. Values are whole numbers wherever the
+// scalar version goes through int64_t, so clipping stays in doubles.
+__attribute__((target("avx2"))) static void
+native_axis_avx2(const int64_t *in, int64_t n, double size,
+                 int64_t level_size, double scaling, double downsample,
+                 double extra, int64_t *level0, int64_t *native_size,
+                 double *fractional) {
+  const __m256d vscaling = _mm256_set1_pd(scaling);
+  const __m256d vdownsample = _mm256_set1_pd(downsample);
+  const __m256d vextra = _mm256_set1_pd(extra);
+  const __m256d vsize = _mm256_set1_pd(size / scaling);
+  const __m256d vzero = _mm256_setzero_pd();
+  const __m256d vlevel_size = _mm256_set1_pd(level_size);
+  for (int64_t i = 0; i < n; i += 4) {
+    __m256d location = int2double(_mm256_loadu_si256((__m256i *)&in[i]));
+    __m256d native_location = _mm256_div_pd(location, vscaling);
+    __m256d native_extent = _mm256_add_pd(native_location, vsize);
+    __m256d left = _mm256_floor_pd(_mm256_sub_pd(native_location, vextra));
+    left = _mm256_min_pd(_mm256_max_pd(left, vzero), vlevel_size);
+    __m256d l0 = _mm256_floor_pd(_mm256_mul_pd(left, vdownsample));
+    __m256d dleft = _mm256_div_pd(l0, vdownsample);
+    __m256d right = _mm256_ceil_pd(_mm256_add_pd(native_extent, vextra));
+    right = _mm256_min_pd(_mm256_max_pd(right, vzero), vlevel_size);
+    __m256d padded = _mm256_ceil_pd(_mm256_sub_pd(right, dleft));
+    _mm256_storeu_si256((__m256i *)&level0[i], double2int(l0));
+    _mm256_storeu_si256((__m256i *)&native_size[i], double2int(padded));
+    _mm256_storeu_pd(&fractional[i], _mm256_sub_pd(native_location, dleft));
+  }
+}
+
+// 0 -> scalar, 1 -> avx2
+static int batch_level = 0;
+
+// Detected once at load, before any thread can build a batch
+__attribute__((constructor)) static void batch_detect(void) {
+  __builtin_cpu_init();
+  batch_level = __builtin_cpu_supports("avx2") ? 1 : 0;
+}
+#endif // BATCH_SIMD
+
+void native_region_requests_soa(request_batch_t *batch, ipos_t size,
+                                native_level_t native_level) {
+#ifdef BATCH_SIMD
+  if (batch_level == 1) {
+    // Whole vectors, then the tail
+    int64_t n = batch->n / 4 * 4;
+    native_axis_avx2(batch->x, n, size.x, native_level.size.x,
+                     native_level.scaling, native_level.downsample,
+                     native_level.extra_pixels, batch->location_x,
+                     batch->size_x, batch->fractional_x);
+    native_axis_avx2(batch->y, n, size.y, native_level.size.y,
+                     native_level.scaling, native_level.downsample,
+                     native_level.extra_pixels, batch->location_y,
+                     batch->size_y, batch->fractional_y);
+    request_batch_t tail = *batch;
+    tail.n -= n;
+    tail.x += n, tail.y += n;
+    tail.location_x += n, tail.location_y += n;
+    tail.size_x += n, tail.size_y += n;
+    tail.fractional_x += n, tail.fractional_y += n;
+    native_region_requests_soa_scalar(&tail, size, native_level);
+    batch->level = tail.level;
+    batch->native_size = tail.native_size;
+    return;
+  }
+#endif
+  native_region_requests_soa_scalar(batch, size, native_level);
+}
+
+request_t request_batch_get(request_batch_t *batch, int64_t i) {
+  request_t request = {
+      .location = {.x = batch->location_x[i], .y = batch->location_y[i]},
+      .level = batch->level,
+      .size = {.x = batch->size_x[i], .y = batch->size_y[i]},
+      .native =
+          {
+              .fractional_coordinates = {.x = batch->fractional_x[i],
+                                         .y = batch->fractional_y[i]},
+              .native_size = batch->native_size,
+          },
+  };
+  return request;
+}
+
+int64_t request_batch_tiling(request_batch_t *batch, tiling_t tiling,
+                             openslide_t *osr, level_props_t level_props) {
+  tiling_grid_t grid;
+  tiling_grid_init(&grid, tiling, level_props);
+  if (request_batch_new(batch, grid.size.x * grid.size.y)) {
+    return -1;
+  }
+
+  // Same walk as read_region_requests
+  int64_t n = 0;
+  ipos_t location;
+  while (tiling_grid_next(&grid, &location)) {
+    batch->x[n] = location.x;
+    batch->y[n] = location.y;
+    n++;
+  }
+  batch->n = n;
+
+  native_level_t native_level =
+      tiling_native_level(tiling, osr, level_props, NULL);
+  native_region_requests_soa(batch, tiling.tile_size, native_level);
+  return n;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "types.h"
+#include <openslide/openslide.h>
+
+// Requests of many tiles of one size at one scaling, as structure of arrays,
+// so native_region_request can run on several tiles per instruction.
+// Arrays are 32 byte aligned, from a single allocation.
+typedef struct request_batch_t {
+  int64_t n;
+  int level;
+  dpos_t native_size; // same for every tile
+  // In: locations, at the batch's scaling
+  int64_t *x, *y;
+  // Out: see request_t
+  int64_t *location_x, *location_y; // level 0
+  int64_t *size_x, *size_y;         // padded, at level
+  double *fractional_x, *fractional_y;
+  void *data;
+} request_batch_t;
+
+// NOTE: Remember to free
+int request_batch_new(request_batch_t *batch, int64_t n);
+void request_batch_free(request_batch_t *batch);
+
+// native_region_request of every ( x[i], y[i] ), bit for bit. AVX2 when
+// available, 4 tiles at a time.
+// NOTE: Assuming valid regions ( see is_valid_region ), so 0 <= x, y < 2^51
+void native_region_requests_soa(request_batch_t *batch, ipos_t size,
+                                native_level_t native_level);
+void native_region_requests_soa_scalar(request_batch_t *batch, ipos_t size,
+                                       native_level_t native_level);
+
+// Request i, as native_region_request would return it
+request_t request_batch_get(request_batch_t *batch, int64_t i);
+
+// Whole tiling grid, in the same order as read_region_requests. Returns the
+// number of requests, -1 on error
+// NOTE: Remember to free
+int64_t request_batch_tiling(request_batch_t *batch, tiling_t tiling,
+                             openslide_t *osr, level_props_t level_props);
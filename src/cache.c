@@ -0,0 +1,273 @@
+#include "cache.h"
+#include <string.h>
+
+static size_t block_bytes(tile_cache_t *cache) {
+  return (size_t)cache->block_size * cache->block_size * sizeof(uint32_t);
+}
+
+tile_cache_t *tile_cache_new(size_t max_bytes, int block_size) {
+  if (block_size <= 0) {
+    block_size = TILE_CACHE_BLOCK_SIZE;
+  }
+  tile_cache_t *cache = calloc(1, sizeof(tile_cache_t));
+  if (!cache) {
+    return NULL;
+  }
+  cache->block_size = block_size;
+  cache->stats.max_bytes = max_bytes;
+
+  // About 2 buckets per block that fits in the budget
+  int64_t max_blocks = max_bytes / block_bytes(cache);
+  cache->bucket_count = 16;
+  while ((cache->bucket_count < (1 << 24)) &
+         (cache->bucket_count < 2 * max_blocks)) {
+    cache->bucket_count *= 2;
+  }
+  cache->buckets = calloc(cache->bucket_count, sizeof(tile_cache_block_t *));
+  if (!cache->buckets) {
+    free(cache);
+    return NULL;
+  }
+  pthread_mutex_init(&cache->lock, NULL);
+  return cache;
+}
+
+// NOTE: No reads may be in flight
+void tile_cache_clear(tile_cache_t *cache) {
+  pthread_mutex_lock(&cache->lock);
+  tile_cache_block_t *block = cache->lru_head;
+  while (block) {
+    tile_cache_block_t *next = block->lru_next;
+    free(block->data);
+    free(block);
+    block = next;
+  }
+  memset(cache->buckets, 0,
+         cache->bucket_count * sizeof(tile_cache_block_t *));
+  cache->lru_head = cache->lru_tail = NULL;
+  cache->stats.blocks = 0;
+  cache->stats.bytes = 0;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void tile_cache_free(tile_cache_t *cache) {
+  if (!cache) {
+    return;
+  }
+  tile_cache_clear(cache);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache->buckets);
+  free(cache);
+}
+
+int tile_cache_level_supported(double downsample) {
+  return (downsample >= 1.0) & (downsample == floor(downsample));
+}
+
+tile_cache_stats_t tile_cache_stats(tile_cache_t *cache) {
+  pthread_mutex_lock(&cache->lock);
+  tile_cache_stats_t stats = cache->stats;
+  pthread_mutex_unlock(&cache->lock);
+  return stats;
+}
+
+static unsigned int bucket(tile_cache_t *cache, int level, ipos_t index) {
+  uint64_t h = (uint64_t)index.x * 0x9E3779B97F4A7C15ull;
+  h ^= (uint64_t)index.y * 0xC2B2AE3D27D4EB4Full + level;
+  h ^= h >> 29;
+  return h & (cache->bucket_count - 1);
+}
+
+// LRU list helpers
+static void lru_unlink(tile_cache_t *cache, tile_cache_block_t *block) {
+  if (block->lru_prev) {
+    block->lru_prev->lru_next = block->lru_next;
+  } else {
+    cache->lru_head = block->lru_next;
+  }
+  if (block->lru_next) {
+    block->lru_next->lru_prev = block->lru_prev;
+  } else {
+    cache->lru_tail = block->lru_prev;
+  }
+  block->lru_prev = block->lru_next = NULL;
+}
+
+static void lru_push_front(tile_cache_t *cache, tile_cache_block_t *block) {
+  block->lru_prev = NULL;
+  block->lru_next = cache->lru_head;
+  if (cache->lru_head) {
+    cache->lru_head->lru_prev = block;
+  }
+  cache->lru_head = block;
+  if (!cache->lru_tail) {
+    cache->lru_tail = block;
+  }
+}
+
+static void evict(tile_cache_t *cache, tile_cache_block_t *block) {
+  // Remove from bucket chain
+  tile_cache_block_t **link =
+      &cache->buckets[bucket(cache, block->level, block->index)];
+  while (*link != block) {
+    link = &(*link)->hash_next;
+  }
+  *link = block->hash_next;
+
+  lru_unlink(cache, block);
+  free(block->data);
+  free(block);
+  cache->stats.blocks -= 1;
+  cache->stats.bytes -= block_bytes(cache);
+  cache->stats.evictions += 1;
+}
+
+// Cached block, pinned, or NULL; a hit becomes most recent
+// NOTE: Call with lock held
+static tile_cache_block_t *lookup(tile_cache_t *cache, int level,
+                                  ipos_t index) {
+  tile_cache_block_t *block = cache->buckets[bucket(cache, level, index)];
+  while (block) {
+    if ((block->level == level) & (block->index.x == index.x) &
+        (block->index.y == index.y)) {
+      lru_unlink(cache, block);
+      lru_push_front(cache, block);
+      block->pins += 1;
+      return block;
+    }
+    block = block->hash_next;
+  }
+  return NULL;
+}
+
+// Evict least recent unpinned blocks until bytes more fit in the budget
+// NOTE: Call with lock held
+static void make_room(tile_cache_t *cache, size_t bytes) {
+  tile_cache_block_t *block = cache->lru_tail;
+  while (block && (cache->stats.bytes + bytes > cache->stats.max_bytes)) {
+    tile_cache_block_t *prev = block->lru_prev;
+    if (!block->pins) {
+      evict(cache, block);
+    }
+    block = prev;
+  }
+}
+
+// Read a missing block from openslide, without the lock
+static tile_cache_block_t *decode(tile_cache_t *cache, openslide_t *osr,
+                                  int level, double downsample,
+                                  ipos_t index) {
+  tile_cache_block_t *block = calloc(1, sizeof(tile_cache_block_t));
+  if (!block) {
+    return NULL;
+  }
+  block->data = malloc(block_bytes(cache));
+  if (!block->data) {
+    free(block);
+    return NULL;
+  }
+  block->level = level;
+  block->index = index;
+  block->pins = 1;
+
+  // Level 0 location of the block, exact for an integral downsample
+  int64_t native_x = index.x * cache->block_size;
+  int64_t native_y = index.y * cache->block_size;
+  openslide_read_region(osr, block->data, native_x * (int64_t)downsample,
+                        native_y * (int64_t)downsample, level,
+                        cache->block_size, cache->block_size);
+  return block;
+}
+
+// Add a decoded, pinned block. If another thread was faster, or the block
+// is over budget, it is returned as is and must be freed by the caller.
+// NOTE: Call with lock held
+static tile_cache_block_t *insert(tile_cache_t *cache,
+                                  tile_cache_block_t *block, int *owned) {
+  size_t bytes = block_bytes(cache);
+  tile_cache_block_t *cached = lookup(cache, block->level, block->index);
+  *owned = 1;
+  if (cached) {
+    free(block->data);
+    free(block);
+    *owned = 0;
+    return cached;
+  }
+  if (bytes > cache->stats.max_bytes) {
+    return block;
+  }
+  make_room(cache, bytes);
+
+  unsigned int b = bucket(cache, block->level, block->index);
+  block->hash_next = cache->buckets[b];
+  cache->buckets[b] = block;
+  lru_push_front(cache, block);
+  cache->stats.blocks += 1;
+  cache->stats.bytes += bytes;
+  *owned = 0;
+  return block;
+}
+
+// Floor division, for negative locations
+static int64_t floor_div(int64_t a, int64_t b) {
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+void tile_cache_read_region(tile_cache_t *cache, openslide_t *osr,
+                            uint32_t *dest, ipos_t origin, int level,
+                            double downsample, ipos_t size) {
+  int64_t bs = cache->block_size;
+  ipos_t first = {.x = floor_div(origin.x, bs), .y = floor_div(origin.y, bs)};
+  ipos_t last = {.x = floor_div(origin.x + size.x - 1, bs),
+                 .y = floor_div(origin.y + size.y - 1, bs)};
+
+  for (int64_t by = first.y; by <= last.y; by++) {
+    for (int64_t bx = first.x; bx <= last.x; bx++) {
+      ipos_t index = {.x = bx, .y = by};
+      int owned = 0;
+
+      pthread_mutex_lock(&cache->lock);
+      tile_cache_block_t *block = lookup(cache, level, index);
+      if (block) {
+        cache->stats.hits += 1;
+      } else {
+        cache->stats.misses += 1;
+      }
+      pthread_mutex_unlock(&cache->lock);
+
+      if (!block) {
+        block = decode(cache, osr, level, downsample, index);
+        if (block) {
+          pthread_mutex_lock(&cache->lock);
+          block = insert(cache, block, &owned);
+          pthread_mutex_unlock(&cache->lock);
+        }
+      }
+
+      // Intersection of block and region, in native pixels
+      int64_t x0 = MAX(origin.x, bx * bs);
+      int64_t x1 = MIN(origin.x + size.x, (bx + 1) * bs);
+      int64_t y0 = MAX(origin.y, by * bs);
+      int64_t y1 = MIN(origin.y + size.y, (by + 1) * bs);
+      for (int64_t y = y0; y < y1; y++) {
+        uint32_t *line = &dest[(y - origin.y) * size.x + (x0 - origin.x)];
+        if (block) {
+          memcpy(line, &block->data[(y - by * bs) * bs + (x0 - bx * bs)],
+                 (x1 - x0) * sizeof(uint32_t));
+        } else {
+          // Out of memory, transparent like openslide outside the level
+          memset(line, 0, (x1 - x0) * sizeof(uint32_t));
+        }
+      }
+
+      if (block && owned) {
+        free(block->data);
+        free(block);
+      } else if (block) {
+        pthread_mutex_lock(&cache->lock);
+        block->pins -= 1;
+        pthread_mutex_unlock(&cache->lock);
+      }
+    }
+  }
+}
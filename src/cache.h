@@ -0,0 +1,56 @@
+#pragma once
+
+#include "types.h"
+#include <pthread.h>
+
+// Default edge of a cached block, in native level pixels
+#define TILE_CACHE_BLOCK_SIZE 256
+
+// Counters, readable through tile_cache_stats
+typedef struct tile_cache_stats_t {
+  int64_t hits;
+  int64_t misses;
+  int64_t evictions;
+  int64_t blocks; // currently cached
+  size_t bytes;   // currently cached
+  size_t max_bytes;
+} tile_cache_stats_t;
+
+// Decoded ARGB block of a level, keyed by (level, block index)
+typedef struct tile_cache_block_t {
+  int level;
+  ipos_t index;
+  uint32_t *data;
+  int pins; // readers copying out of it, not evicted while > 0
+  struct tile_cache_block_t *hash_next;
+  struct tile_cache_block_t *lru_prev, *lru_next; // head is most recent
+} tile_cache_block_t;
+
+// LRU cache of native level blocks, with a byte budget.
+// Thread safe: the lock is not held while decoding or copying blocks.
+typedef struct tile_cache_t {
+  pthread_mutex_t lock;
+  int block_size;
+  int bucket_count; // power of 2
+  tile_cache_block_t **buckets;
+  tile_cache_block_t *lru_head, *lru_tail;
+  tile_cache_stats_t stats;
+} tile_cache_t;
+
+// NOTE: Remember to free
+tile_cache_t *tile_cache_new(size_t max_bytes, int block_size);
+void tile_cache_free(tile_cache_t *cache);
+void tile_cache_clear(tile_cache_t *cache);
+tile_cache_stats_t tile_cache_stats(tile_cache_t *cache);
+
+// Blocks give the same pixels as openslide_read_region only on levels whose
+// native pixels start on whole level 0 pixels: integral downsamples. Reads of
+// other levels must bypass the cache.
+int tile_cache_level_supported(double downsample);
+
+// Like openslide_read_region, assembled from cached blocks, with origin in
+// native level pixels. Only missing blocks are read from openslide.
+// NOTE: downsample must be supported, see tile_cache_level_supported
+void tile_cache_read_region(tile_cache_t *cache, openslide_t *osr,
+                            uint32_t *dest, ipos_t origin, int level,
+                            double downsample, ipos_t size);
@@ -0,0 +1,126 @@
+#include "descriptor.h"
+#include <inttypes.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Fixed part of the file
+typedef struct descriptor_header_t {
+  char magic[8]; // SLIDE_DESCRIPTOR_MAGIC, with its '\0'
+  uint32_t version;
+  uint32_t byte_order;
+  int32_t level_count;
+  int32_t reserved;
+  char quickhash[OSLIDE_QUICKHASH_SIZE];
+  double props[4];   // mpp, magnification, spacings
+  int64_t iprops[7]; // size, offset, bounds, background
+} descriptor_header_t;
+
+int slide_descriptor_write(slide_descriptor_t *descriptor, const char *path) {
+  slide_props_t *props = &descriptor->slide_props;
+  level_props_t *levels = &descriptor->level_props;
+  descriptor_header_t header;
+  memset(&header, 0, sizeof(descriptor_header_t));
+  memcpy(header.magic, SLIDE_DESCRIPTOR_MAGIC, sizeof(SLIDE_DESCRIPTOR_MAGIC));
+  header.version = SLIDE_DESCRIPTOR_VERSION;
+  header.byte_order = SLIDE_DESCRIPTOR_BYTE_ORDER;
+  header.level_count = levels->level_count;
+  memcpy(header.quickhash, descriptor->quickhash, OSLIDE_QUICKHASH_SIZE);
+  header.quickhash[OSLIDE_QUICKHASH_SIZE - 1] = '\0';
+  double dprops[4] = {props->mpp, props->magnification, props->spacings.x,
+                      props->spacings.y};
+  int64_t iprops[7] = {props->size.x,   props->size.y,   props->offset.x,
+                       props->offset.y, props->bounds.x, props->bounds.y,
+                       props->background};
+  memcpy(header.props, dprops, sizeof(dprops));
+  memcpy(header.iprops, iprops, sizeof(iprops));
+
+  // Unique per process, renamed over path once complete
+  char tmp_path[4096];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+  FILE *fp = fopen(tmp_path, "wb");
+  if (!fp) {
+    return 1;
+  }
+  int n = levels->level_count;
+  int err = fwrite(&header, sizeof(header), 1, fp) != 1;
+  err |= fwrite(levels->level_dimensions, sizeof(ipos_t), n, fp) != (size_t)n;
+  err |= fwrite(levels->level_downsamples, sizeof(double), n, fp) != (size_t)n;
+  err |= fclose(fp) != 0;
+  if (err || rename(tmp_path, path)) {
+    remove(tmp_path);
+    return 1;
+  }
+  return 0;
+}
+
+int slide_descriptor_read(slide_descriptor_t *descriptor, const char *path) {
+  memset(descriptor, 0, sizeof(slide_descriptor_t));
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    return 1;
+  }
+  descriptor_header_t header;
+  if ((fread(&header, sizeof(header), 1, fp) != 1) ||
+      memcmp(header.magic, SLIDE_DESCRIPTOR_MAGIC,
+             sizeof(SLIDE_DESCRIPTOR_MAGIC)) ||
+      (header.version != SLIDE_DESCRIPTOR_VERSION) ||
+      (header.byte_order != SLIDE_DESCRIPTOR_BYTE_ORDER) ||
+      (header.level_count <= 0)) {
+    fclose(fp);
+    return 1;
+  }
+
+  int n = header.level_count;
+  level_props_t *levels = &descriptor->level_props;
+  levels->level_count = n;
+  levels->level_dimensions = malloc(n * sizeof(ipos_t));
+  levels->level_downsamples = malloc(n * sizeof(double));
+  if (!levels->level_dimensions || !levels->level_downsamples ||
+      (fread(levels->level_dimensions, sizeof(ipos_t), n, fp) != (size_t)n) ||
+      (fread(levels->level_downsamples, sizeof(double), n, fp) !=
+       (size_t)n)) {
+    free(levels->level_dimensions);
+    free(levels->level_downsamples);
+    memset(descriptor, 0, sizeof(slide_descriptor_t));
+    fclose(fp);
+    return 1;
+  }
+  fclose(fp);
+
+  memcpy(descriptor->quickhash, header.quickhash, OSLIDE_QUICKHASH_SIZE);
+  descriptor->quickhash[OSLIDE_QUICKHASH_SIZE - 1] = '\0';
+  slide_props_t *props = &descriptor->slide_props;
+  props->mpp = header.props[0];
+  props->magnification = header.props[1];
+  props->spacings = (dpos_t){.x = header.props[2], .y = header.props[3]};
+  props->size = (ipos_t){.x = header.iprops[0], .y = header.iprops[1]};
+  props->offset = (ipos_t){.x = header.iprops[2], .y = header.iprops[3]};
+  props->bounds = (ipos_t){.x = header.iprops[4], .y = header.iprops[5]};
+  props->background = header.iprops[6];
+  levels->slide_size = props->size;
+  return 0;
+}
+
+// FNV-1a, 64 bits
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t n) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < n; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+int slide_descriptor_cache_path(char *buf, size_t n, const char *cache_dir,
+                                const char *slide_path) {
+  struct stat st;
+  if (!cache_dir || stat(slide_path, &st)) {
+    return 1;
+  }
+  int64_t size = st.st_size, mtime = st.st_mtime;
+  uint64_t hash = fnv1a(0xcbf29ce484222325ull, slide_path, strlen(slide_path));
+  hash = fnv1a(hash, &size, sizeof(size));
+  hash = fnv1a(hash, &mtime, sizeof(mtime));
+  int written = snprintf(buf, n, "%s/%016" PRIx64 ".osd", cache_dir, hash);
+  return (written < 0) | ((size_t)written >= n);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "types.h"
+
+// openslide.quickhash-1 is a sha256, in hex
+#define OSLIDE_QUICKHASH_SIZE 72
+
+#define SLIDE_DESCRIPTOR_MAGIC "OSDESC"
+#define SLIDE_DESCRIPTOR_VERSION 1
+#define SLIDE_DESCRIPTOR_BYTE_ORDER 0x01020304
+
+// Everything needed to plan tilings of a slide, without openslide
+typedef struct slide_descriptor_t {
+  char quickhash[OSLIDE_QUICKHASH_SIZE]; // of the slide it was made from
+  slide_props_t slide_props;
+  level_props_t level_props;
+} slide_descriptor_t;
+
+// Binary file: magic, version, byte order, level count and quickhash, then
+// props and level arrays, native byte order. Written to a temporary file and
+// renamed, so concurrent loaders never see a partial descriptor.
+int slide_descriptor_write(slide_descriptor_t *descriptor, const char *path);
+
+// NOTE: Remember to free level_props' arrays ( or hand them to an oslide_t )
+int slide_descriptor_read(slide_descriptor_t *descriptor, const char *path);
+
+// <cache_dir>/<hash of path, file size and mtime>.osd. The quickhash needs
+// the slide opened, so it is checked when pixels are first needed instead,
+// see oslide_osr
+int slide_descriptor_cache_path(char *buf, size_t n, const char *cache_dir,
+                                const char *slide_path);
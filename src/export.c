@@ -0,0 +1,39 @@
+#include "export.h"
+#include "vimage.h"
+
+int oslide_export_tiff(oslide_t *oslide, double scaling, const char *path,
+                       export_options_t options) {
+  if (VIPS_INIT("c-vips-openslide")) {
+    return 1;
+  }
+  int tile_size = options.tile_size > 0 ? options.tile_size : EXPORT_TILE_SIZE;
+  int quality = options.quality > 0 ? options.quality : EXPORT_QUALITY;
+  // Process wide, so put it back for the rest of the host program
+  int concurrency = vips_concurrency_get();
+  if (options.threads > 0) {
+    vips_concurrency_set(options.threads);
+  }
+
+  VipsImage *image = oslide_vips_image(oslide, scaling);
+  if (!image) {
+    vips_concurrency_set(concurrency);
+    return 1;
+  }
+
+  uint32_t color = oslide->slide_props.background;
+  double background[3] = {color >> 16 & 0xff, color >> 8 & 0xff, color & 0xff};
+  VipsArrayDouble *vbackground = vips_array_double_new(background, 3);
+  VipsImage *flat;
+  int err = vips_flatten(image, &flat, "background", vbackground, NULL);
+  vips_area_unref(VIPS_AREA(vbackground));
+  if (!err) {
+    err = vips_tiffsave(flat, path, "tile", TRUE, "tile_width", tile_size,
+                        "tile_height", tile_size, "pyramid", TRUE,
+                        "compression", VIPS_FOREIGN_TIFF_COMPRESSION_JPEG, "Q",
+                        quality, "bigtiff", TRUE, NULL);
+    g_object_unref(flat);
+  }
+  g_object_unref(image);
+  vips_concurrency_set(concurrency);
+  return err;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "slide.h"
+
+// Defaults of export_options_t
+#define EXPORT_TILE_SIZE 256
+#define EXPORT_QUALITY 90
+
+typedef struct export_options_t {
+  int tile_size; // 0 -> EXPORT_TILE_SIZE
+  int quality;   // JPEG Q, 0 -> EXPORT_QUALITY
+  int threads;   // 0 -> vips default, all cores; restored after export
+} export_options_t;
+
+// Whole slide at scaling ( see osr_scaling for a target mpp ) as a tiled,
+// pyramidal, JPEG compressed TIFF. tiffsave pulls oslide_vips_image on vips'
+// threadpool, so memory stays at a few strips of tiles whatever the slide
+// size. Alpha is flattened over the slide's background color.
+// NOTE: Worker threads use the slide's handle pool, if opened
+int oslide_export_tiff(oslide_t *oslide, double scaling, const char *path,
+                       export_options_t options);
@@ -0,0 +1,183 @@
+#include "index.h"
+#include "slide.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bytes of an index of count records, 0 when that doesn't fit in size_t
+static size_t index_length(int64_t count) {
+  if ((count < 0) ||
+      ((uint64_t)count > (SIZE_MAX - sizeof(request_index_header_t)) /
+                             sizeof(request_record_t))) {
+    return 0;
+  }
+  return sizeof(request_index_header_t) + count * sizeof(request_record_t);
+}
+
+// Map length bytes of fd, set header and records
+static int index_map(request_index_t *index, size_t length) {
+  int prot = index->writable ? PROT_READ | PROT_WRITE : PROT_READ;
+  void *data = mmap(NULL, length, prot, MAP_SHARED, index->fd, 0);
+  if (data == MAP_FAILED) {
+    return 1;
+  }
+  index->length = length;
+  index->header = data;
+  index->records =
+      (request_record_t *)((char *)data + sizeof(request_index_header_t));
+  return 0;
+}
+
+int request_index_create(request_index_t *index, const char *path,
+                         int64_t count) {
+  memset(index, 0, sizeof(request_index_t));
+  index->fd = -1;
+  size_t length = index_length(count);
+  if (!length) {
+    return 1;
+  }
+  index->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (index->fd < 0) {
+    return 1;
+  }
+  index->writable = 1;
+  if (ftruncate(index->fd, length) || index_map(index, length)) {
+    close(index->fd);
+    return 1;
+  }
+
+  // File is zero filled by ftruncate, only the header is needed
+  request_index_header_t *header = index->header;
+  memcpy(header->magic, REQUEST_INDEX_MAGIC, sizeof(REQUEST_INDEX_MAGIC));
+  header->version = REQUEST_INDEX_VERSION;
+  header->byte_order = REQUEST_INDEX_BYTE_ORDER;
+  header->record_size = sizeof(request_record_t);
+  header->count = count;
+  index->count = count;
+  return 0;
+}
+
+int request_index_open(request_index_t *index, const char *path) {
+  memset(index, 0, sizeof(request_index_t));
+  index->fd = open(path, O_RDONLY);
+  if (index->fd < 0) {
+    return 1;
+  }
+  struct stat st;
+  if (fstat(index->fd, &st) ||
+      ((size_t)st.st_size < sizeof(request_index_header_t)) ||
+      index_map(index, st.st_size)) {
+    close(index->fd);
+    return 1;
+  }
+
+  request_index_header_t *header = index->header;
+  if (memcmp(header->magic, REQUEST_INDEX_MAGIC,
+             sizeof(REQUEST_INDEX_MAGIC)) ||
+      (header->version != REQUEST_INDEX_VERSION) ||
+      (header->byte_order != REQUEST_INDEX_BYTE_ORDER) ||
+      (header->record_size != sizeof(request_record_t)) ||
+      !index_length(header->count) ||
+      (index_length(header->count) > index->length)) {
+    request_index_close(index);
+    return 1;
+  }
+  index->count = header->count;
+  return 0;
+}
+
+int request_index_truncate(request_index_t *index, int64_t count) {
+  if (!index->writable | (count < 0) | (count > index->count)) {
+    return 1;
+  }
+  index->header->count = count;
+  index->count = count;
+  size_t length = index_length(count);
+  munmap(index->header, index->length);
+  if (ftruncate(index->fd, length) || index_map(index, length)) {
+    index->header = NULL;
+    index->records = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+int request_index_close(request_index_t *index) {
+  int err = 0;
+  if (index->header) {
+    if (index->writable) {
+      err |= msync(index->header, index->length, MS_SYNC);
+    }
+    err |= munmap(index->header, index->length);
+  }
+  err |= close(index->fd);
+  memset(index, 0, sizeof(request_index_t));
+  index->fd = -1;
+  return err ? 1 : 0;
+}
+
+int64_t request_index_write_tiling(const char *path, tiling_t tiling,
+                                   openslide_t *osr,
+                                   level_props_t level_props) {
+  ipos_t grid_size = tiling_grid_size(tiling, level_props);
+  request_index_t index;
+  if (request_index_create(&index, path, grid_size.x * grid_size.y)) {
+    return -1;
+  }
+  int64_t n = read_region_records(tiling, osr, level_props, index.records);
+  int err = request_index_truncate(&index, n);
+  err |= request_index_close(&index);
+  return err ? -1 : n;
+}
+
+// One data row of requests.csv, see print_lss_row and print_request_row
+static int read_csv_record(FILE *fp, request_record_t *r) {
+  return fscanf(fp, "%ld,%ld,%lf,%ld,%ld,%ld,%ld,%d,%ld,%ld,%lf,%lf,%lf,%lf\n",
+                &r->location.x, &r->location.y, &r->scaling, &r->size.x,
+                &r->size.y, &r->request.location.x, &r->request.location.y,
+                &r->request.level, &r->request.size.x, &r->request.size.y,
+                &r->request.native.fractional_coordinates.x,
+                &r->request.native.fractional_coordinates.y,
+                &r->request.native.native_size.x,
+                &r->request.native.native_size.y) == 14;
+}
+
+// Past the header row of requests.csv, 1 if there is none
+static int skip_csv_header(FILE *fp) { return fscanf(fp, "%*[^\n]\n") == EOF; }
+
+int64_t request_index_from_csv(const char *path, const char *csv_path) {
+  FILE *fp = fopen(csv_path, "r");
+  if (!fp) {
+    return -1;
+  }
+
+  // Count rows first, so the mapping is sized once
+  int64_t count = 0;
+  request_record_t record;
+  if (skip_csv_header(fp)) {
+    fclose(fp);
+    return -1;
+  }
+  while (read_csv_record(fp, &record)) {
+    count++;
+  }
+
+  request_index_t index;
+  if (request_index_create(&index, path, count)) {
+    fclose(fp);
+    return -1;
+  }
+  rewind(fp);
+  int64_t n = 0;
+  if (!skip_csv_header(fp)) {
+    while ((n < count) && read_csv_record(fp, &index.records[n])) {
+      n++;
+    }
+  }
+  fclose(fp);
+  int err = request_index_truncate(&index, n);
+  err |= request_index_close(&index);
+  return err ? -1 : n;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "types.h"
+#include <openslide/openslide.h>
+
+// Binary, fixed width version of requests.csv: a header, then count
+// request_record_t in native byte order. mmap-able, record i is at
+// sizeof(request_index_header_t) + i * sizeof(request_record_t).
+#define REQUEST_INDEX_MAGIC "OSRQIDX"
+#define REQUEST_INDEX_VERSION 1
+#define REQUEST_INDEX_BYTE_ORDER 0x01020304
+
+// 64 bytes, records are 112 bytes on LP64
+typedef struct request_index_header_t {
+  char magic[8]; // REQUEST_INDEX_MAGIC, with its '\0'
+  uint32_t version;
+  uint32_t byte_order;  // REQUEST_INDEX_BYTE_ORDER as written
+  uint32_t record_size; // sizeof(request_record_t)
+  uint32_t reserved0;
+  int64_t count;
+  uint8_t reserved[32];
+} request_index_header_t;
+
+// Mapped index, read only from request_index_open
+typedef struct request_index_t {
+  int fd;
+  int writable;
+  size_t length; // mapped bytes
+  request_index_header_t *header;
+  request_record_t *records;
+  int64_t count;
+} request_index_t;
+
+// New index of count zeroed records, mapped writable
+// NOTE: Remember to close
+int request_index_create(request_index_t *index, const char *path,
+                         int64_t count);
+
+// Existing index, mapped read only. Fails on a bad header or truncated file
+// NOTE: Remember to close
+int request_index_open(request_index_t *index, const char *path);
+
+// Keep the first count records ( <= index->count ), writable only
+int request_index_truncate(request_index_t *index, int64_t count);
+
+// Flushes a writable index
+int request_index_close(request_index_t *index);
+
+// O(1), no bounds check
+static inline request_record_t *request_index_get(request_index_t *index,
+                                                  int64_t i) {
+  return &index->records[i];
+}
+
+// Whole tiling grid, written straight into the mapping ( see
+// read_region_records ). Returns number of records written, -1 on error
+int64_t request_index_write_tiling(const char *path, tiling_t tiling,
+                                   openslide_t *osr,
+                                   level_props_t level_props);
+
+// Convert a requests.csv ( header, then print_lss_row + print_request_row
+// rows ). Returns number of records written, -1 on error
+int64_t request_index_from_csv(const char *path, const char *csv_path);
@@ -1,3 +1,4 @@
+#include "mask.h"
 #include "slide.h"
 #include "types.h"
 
@@ -21,14 +22,33 @@ int main(void) {
                                           oslide.level_props);
   print_request(request);
 
-  // BUG: FAILING
+  // Whole grid of requests at the same scaling
+  tiling_t tiling = {.scaling = scaling, .tile_size = size};
+  int64_t n_requests;
+  request_t *requests = read_region_requests(tiling, oslide.osr,
+                                             oslide.level_props, &n_requests);
+  printf("requests: %ld\n", n_requests);
+
+  // Drop requests over background before reading them
+  tissue_mask_t mask;
+  tissue_mask_options_t mask_options = {.source = TISSUE_MASK_LOWEST_LEVEL,
+                                        .threshold = -1};
+  if (!tissue_mask_new(&mask, &oslide, mask_options)) {
+    n_requests = tissue_mask_filter(&mask, requests, n_requests,
+                                    oslide.level_props, 0.1);
+    printf("tissue  : %ld ( threshold %d )\n", n_requests, mask.threshold);
+    tissue_mask_free(&mask);
+  }
+  free(requests);
+
   // Go further and get the region
-  // image_t region = {
-  //     .width = size.x,
-  //     .height = size.y,
-  //     .bands = 4,
-  //     .data = malloc(size.x * size.y * sizeof(uint32_t))};
-  // read_region(&region, oslide.osr, request);
+  image_t region = {.width = size.x,
+                    .height = size.y,
+                    .bands = 4,
+                    .data = malloc(size.x * size.y * sizeof(uint32_t))};
+  int err = read_region(&region, oslide.osr, request);
+  printf("read_region: %d\n", err);
+  free(region.data);
 
   // Close and free
   oslide_close(&oslide);
@@ -0,0 +1,189 @@
+#include "mask.h"
+#include <string.h>
+
+// HSV saturation of a straight RGBA pixel ( little endian uint32 )
+static uint8_t saturation(uint32_t pixel) {
+  uint8_t r = pixel, g = pixel >> 8, b = pixel >> 16, a = pixel >> 24;
+  uint8_t max = MAX(r, MAX(g, b));
+  uint8_t min = MIN(r, MIN(g, b));
+  if ((a == 0) | (max == 0)) {
+    return 0;
+  }
+  return 255 * (max - min) / max;
+}
+
+// Threshold maximizing the between class variance of the histogram
+static int otsu(int64_t histogram[256]) {
+  int64_t total = 0;
+  double sum = 0.0;
+  for (int i = 0; i < 256; i++) {
+    total += histogram[i];
+    sum += (double)i * histogram[i];
+  }
+
+  int64_t weight_bg = 0;
+  double sum_bg = 0.0, best_variance = -1.0;
+  int threshold = 0;
+  for (int t = 0; t < 256; t++) {
+    weight_bg += histogram[t];
+    if ((weight_bg == 0) | (weight_bg == total)) {
+      continue;
+    }
+    sum_bg += (double)t * histogram[t];
+    int64_t weight_fg = total - weight_bg;
+    double mean_bg = sum_bg / weight_bg;
+    double mean_fg = (sum - sum_bg) / weight_fg;
+    double variance =
+        (double)weight_bg * weight_fg * (mean_bg - mean_fg) * (mean_bg - mean_fg);
+    if (variance > best_variance) {
+      best_variance = variance;
+      threshold = t;
+    }
+  }
+  return threshold;
+}
+
+// Source pixels as RGBA, whole slide
+static int read_source(image_t *image, oslide_t *oslide,
+                       tissue_mask_source_t source) {
+  openslide_t *osr = oslide_osr(oslide);
+  if (!osr) {
+    return 1;
+  }
+  if (source == TISSUE_MASK_THUMBNAIL) {
+    if (osr_thumbnail(osr, image, Thumbnail)) {
+      return 1;
+    }
+    if (openslide_get_error(osr)) {
+      free(image->data);
+      return 1;
+    }
+    return 0;
+  }
+
+  int level = oslide->level_props.level_count - 1;
+  ipos_t size = oslide->level_props.level_dimensions[level];
+  image->width = size.x;
+  image->height = size.y;
+  image->bands = 4;
+  image->format = IMAGE_RGBA;
+  image->data = malloc(size.x * size.y * sizeof(uint32_t));
+  if (!image->data) {
+    return 1;
+  }
+  openslide_read_region(osr, image->data, 0, 0, level, size.x, size.y);
+  // Failed reads are all transparent, which would pass for no tissue
+  if (openslide_get_error(osr)) {
+    free(image->data);
+    image->data = NULL;
+    return 1;
+  }
+  argb2rgba(image->data, size.x * size.y);
+  return 0;
+}
+
+int tissue_mask_new(tissue_mask_t *mask, oslide_t *oslide,
+                    tissue_mask_options_t options) {
+  image_t image;
+  if (read_source(&image, oslide, options.source)) {
+    memset(mask, 0, sizeof(tissue_mask_t));
+    return 1;
+  }
+  int err = tissue_mask_from_image(mask, &image, oslide->level_props.slide_size,
+                                   options.threshold);
+  free(image.data);
+  return err;
+}
+
+int tissue_mask_from_image(tissue_mask_t *mask, image_t *image,
+                           ipos_t slide_size, int threshold) {
+  memset(mask, 0, sizeof(tissue_mask_t));
+  int64_t n = (int64_t)image->width * image->height;
+  mask->size.x = image->width;
+  mask->size.y = image->height;
+  mask->downsample.x = (double)slide_size.x / image->width;
+  mask->downsample.y = (double)slide_size.y / image->height;
+  mask->data = malloc(n);
+  mask->integral = calloc((mask->size.x + 1) * (mask->size.y + 1),
+                          sizeof(int64_t));
+  if (!mask->data || !mask->integral) {
+    tissue_mask_free(mask);
+    return 1;
+  }
+
+  // Saturation in place of the mask, then threshold
+  int64_t histogram[256] = {0};
+  for (int64_t i = 0; i < n; i++) {
+    mask->data[i] = saturation(image->data[i]);
+    histogram[mask->data[i]] += 1;
+  }
+  mask->threshold = threshold < 0 ? otsu(histogram) : threshold;
+  for (int64_t i = 0; i < n; i++) {
+    mask->data[i] = mask->data[i] > mask->threshold;
+  }
+
+  // integral[y + 1][x + 1] = tissue pixels in [0, x] x [0, y]
+  int64_t stride = mask->size.x + 1;
+  for (int64_t y = 0; y < mask->size.y; y++) {
+    int64_t row = 0;
+    for (int64_t x = 0; x < mask->size.x; x++) {
+      row += mask->data[y * mask->size.x + x];
+      mask->integral[(y + 1) * stride + x + 1] =
+          mask->integral[y * stride + x + 1] + row;
+    }
+  }
+  return 0;
+}
+
+void tissue_mask_free(tissue_mask_t *mask) {
+  free(mask->data);
+  free(mask->integral);
+  mask->data = NULL;
+  mask->integral = NULL;
+}
+
+double tissue_mask_coverage(tissue_mask_t *mask, ipos_t location,
+                            ipos_t size) {
+  // Mask pixels touched by the rectangle
+  int64_t x0 = floor(location.x / mask->downsample.x);
+  int64_t y0 = floor(location.y / mask->downsample.y);
+  int64_t x1 = ceil((location.x + size.x) / mask->downsample.x);
+  int64_t y1 = ceil((location.y + size.y) / mask->downsample.y);
+  int64_t area = (x1 - x0) * (y1 - y0);
+  if (area <= 0) {
+    return 0.0;
+  }
+
+  x0 = MIN(MAX(x0, 0), mask->size.x);
+  y0 = MIN(MAX(y0, 0), mask->size.y);
+  x1 = MIN(MAX(x1, 0), mask->size.x);
+  y1 = MIN(MAX(y1, 0), mask->size.y);
+  int64_t stride = mask->size.x + 1;
+  int64_t tissue = mask->integral[y1 * stride + x1] -
+                   mask->integral[y0 * stride + x1] -
+                   mask->integral[y1 * stride + x0] +
+                   mask->integral[y0 * stride + x0];
+  return (double)tissue / area;
+}
+
+double tissue_mask_request_coverage(tissue_mask_t *mask, request_t request,
+                                    level_props_t level_props) {
+  double downsample = level_props.level_downsamples[request.level];
+  dpos_t origin = _addv(_double(request.location),
+                        _mul(request.native.fractional_coordinates, downsample));
+  dpos_t size = _mul(request.native.native_size, downsample);
+  return tissue_mask_coverage(mask, _int(_floor(origin)), _int(_ceil(size)));
+}
+
+int64_t tissue_mask_filter(tissue_mask_t *mask, request_t *requests,
+                           int64_t n_requests, level_props_t level_props,
+                           double min_coverage) {
+  int64_t kept = 0;
+  for (int64_t i = 0; i < n_requests; i++) {
+    if (tissue_mask_request_coverage(mask, requests[i], level_props) >=
+        min_coverage) {
+      requests[kept++] = requests[i];
+    }
+  }
+  return kept;
+}
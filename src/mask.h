@@ -0,0 +1,47 @@
+#pragma once
+
+#include "slide.h"
+
+// Where the mask pixels come from
+typedef enum tissue_mask_source_t {
+  TISSUE_MASK_LOWEST_LEVEL, // exact geometry, via level_props
+  TISSUE_MASK_THUMBNAIL,    // osr_thumbnail, assumed to span the whole slide
+} tissue_mask_source_t;
+
+typedef struct tissue_mask_options_t {
+  tissue_mask_source_t source;
+  int threshold; // saturation, 0-255, tissue is above. < 0 -> Otsu
+} tissue_mask_options_t;
+
+// Low resolution tissue mask, with a summed area table for O(1) coverage
+typedef struct tissue_mask_t {
+  ipos_t size;       // mask pixels
+  dpos_t downsample; // level 0 pixels per mask pixel
+  int threshold;     // saturation threshold actually used
+  uint8_t *data;     // 1 -> tissue, row major
+  int64_t *integral; // (size.x + 1) * (size.y + 1)
+} tissue_mask_t;
+
+// Threshold HSV saturation of the source, transparent pixels are background
+// NOTE: Remember to free
+int tissue_mask_new(tissue_mask_t *mask, oslide_t *oslide,
+                    tissue_mask_options_t options);
+void tissue_mask_free(tissue_mask_t *mask);
+
+// Same, from an RGBA image spanning a slide of slide_size level 0 pixels
+int tissue_mask_from_image(tissue_mask_t *mask, image_t *image,
+                           ipos_t slide_size, int threshold);
+
+// Fraction of tissue within a level 0 rectangle, outside the slide is not
+double tissue_mask_coverage(tissue_mask_t *mask, ipos_t location,
+                            ipos_t size);
+
+// Same, for the area a request resamples ( without the extra pixels )
+double tissue_mask_request_coverage(tissue_mask_t *mask, request_t request,
+                                    level_props_t level_props);
+
+// Keep requests with at least min_coverage tissue, in order, in place.
+// Returns the number kept.
+int64_t tissue_mask_filter(tissue_mask_t *mask, request_t *requests,
+                           int64_t n_requests, level_props_t level_props,
+                           double min_coverage);
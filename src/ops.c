@@ -1,4 +1,5 @@
 #include "ops.h"
+#include <string.h>
 
 // Clip values from 0 to size boundaries.
 ipos_t clip2size(ipos_t a, ipos_t size) {
@@ -80,8 +81,58 @@ dpos_t _subv(dpos_t a, dpos_t b) {
   return ret;
 }
 
-// From openslide python - convert in place
-void argb2rgba(uint32_t *buf, int len) {
+static int64_t gcd(int64_t a, int64_t b) {
+  a = a < 0 ? -a : a;
+  b = b < 0 ? -b : b;
+  while (b) {
+    int64_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a ? a : 1;
+}
+
+rational_t rational(int64_t num, int64_t den) {
+  int64_t g = gcd(num, den) * (den < 0 ? -1 : 1);
+  rational_t ret = {.num = num / g, .den = den / g};
+  return ret;
+}
+
+rational_t rational_mul(rational_t a, rational_t b) {
+  // Cross reduce first, so the products are as small as they can be
+  int64_t g1 = gcd(a.num, b.den), g2 = gcd(b.num, a.den);
+  return rational((a.num / g1) * (b.num / g2), (a.den / g2) * (b.den / g1));
+}
+
+double rational_double(rational_t a) { return (double)a.num / a.den; }
+
+rational_t rational_from_double(double x, int64_t max_den) {
+  // Convergents h / k of the continued fraction of x
+  int64_t h0 = 0, h1 = 1, k0 = 1, k1 = 0;
+  double r = x;
+  for (int i = 0; i < 64; i++) {
+    double a = floor(r);
+    if ((fabs(a) > (double)INT64_MAX / 2) | (a * k1 + k0 > max_den)) {
+      break;
+    }
+    int64_t h2 = (int64_t)a * h1 + h0, k2 = (int64_t)a * k1 + k0;
+    h0 = h1, h1 = h2, k0 = k1, k1 = k2;
+    if ((r - a == 0.0) | ((double)h1 / k1 == x)) {
+      break;
+    }
+    r = 1.0 / (r - a);
+  }
+  return k1 ? rational(h1, k1) : rational((int64_t)round(x), 1);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) &&       \
+    !defined(WORDS_BIGENDIAN)
+#define OPS_SIMD 1
+#include <immintrin.h>
+#endif
+
+// From openslide python - convert in place ( reference, see argb2rgba )
+void argb2rgba_scalar(uint32_t *buf, int len) {
   int64_t cur;
   for (cur = 0; cur < len; cur++) {
     uint32_t val = buf[cur];
@@ -112,3 +163,240 @@ void argb2rgba(uint32_t *buf, int len) {
     }
   }
 }
+
+// ceil(255 * 2^16 / a): (c * table[a]) >> 16 == 255 * c / a, for c, a < 256
+static const uint32_t unpremultiply_table[256] = {
+    0, 16711680, 8355840, 5570560, 4177920, 3342336, 2785280, 2387383, 2088960,
+    1856854, 1671168, 1519244, 1392640, 1285514, 1193692, 1114112, 1044480,
+    983040, 928427, 879563, 835584, 795795, 759622, 726595, 696320, 668468,
+    642757, 618952, 596846, 576265, 557056, 539087, 522240, 506415, 491520,
+    477477, 464214, 451668, 439782, 428505, 417792, 407602, 397898, 388644,
+    379811, 371371, 363298, 355568, 348160, 341055, 334234, 327680, 321379,
+    315315, 309476, 303849, 298423, 293188, 288133, 283249, 278528, 273962,
+    269544, 265265, 261120, 257103, 253208, 249429, 245760, 242199, 238739,
+    235376, 232107, 228928, 225834, 222823, 219891, 217035, 214253, 211541,
+    208896, 206318, 203801, 201346, 198949, 196608, 194322, 192089, 189906,
+    187772, 185686, 183645, 181649, 179696, 177784, 175913, 174080, 172286,
+    170528, 168805, 167117, 165463, 163840, 162250, 160690, 159159, 157658,
+    156184, 154738, 153319, 151925, 150556, 149212, 147891, 146594, 145319,
+    144067, 142835, 141625, 140435, 139264, 138114, 136981, 135868, 134772,
+    133694, 132633, 131589, 130560, 129548, 128552, 127571, 126604, 125652,
+    124715, 123791, 122880, 121984, 121100, 120228, 119370, 118523, 117688,
+    116865, 116054, 115253, 114464, 113685, 112917, 112159, 111412, 110674,
+    109946, 109227, 108518, 107818, 107127, 106444, 105771, 105105, 104448,
+    103800, 103159, 102526, 101901, 101283, 100673, 100070, 99475, 98886, 98304,
+    97730, 97161, 96600, 96045, 95496, 94953, 94417, 93886, 93362, 92843, 92330,
+    91823, 91321, 90825, 90334, 89848, 89368, 88892, 88422, 87957, 87496, 87040,
+    86590, 86143, 85701, 85264, 84831, 84403, 83979, 83559, 83143, 82732, 82324,
+    81920, 81521, 81125, 80733, 80345, 79961, 79580, 79203, 78829, 78459, 78092,
+    77729, 77369, 77013, 76660, 76310, 75963, 75619, 75278, 74941, 74606, 74275,
+    73946, 73620, 73297, 72977, 72660, 72345, 72034, 71724, 71418, 71114, 70813,
+    70514, 70218, 69924, 69632, 69344, 69057, 68773, 68491, 68211, 67934, 67659,
+    67386, 67116, 66847, 66581, 66317, 66055, 65795, 65536,
+};
+
+// Same result as argb2rgba_scalar, without the division
+static inline uint32_t argb2rgba_pixel(uint32_t val) {
+  uint32_t a = val >> 24;
+  if (a == 0) {
+    return val;
+  }
+  uint32_t m = unpremultiply_table[a];
+  uint8_t r = (((val >> 16) & 0xff) * m) >> 16;
+  uint8_t g = (((val >> 8) & 0xff) * m) >> 16;
+  uint8_t b = (((val >> 0) & 0xff) * m) >> 16;
+  return a << 24 | b << 16 | g << 8 | r;
+}
+
+#ifdef OPS_SIMD
+
+// ARGB -> RGBA bytes, for opaque pixels
+#define ARGB2RGBA_SHUFFLE                                                      \
+  2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+
+__attribute__((target("ssse3"))) static void argb2rgba_ssse3(uint32_t *buf,
+                                                             int len) {
+  const __m128i shuffle = _mm_setr_epi8(ARGB2RGBA_SHUFFLE);
+  const __m128i opaque = _mm_set1_epi32(0xff000000);
+  int64_t cur;
+  for (cur = 0; cur + 3 < len; cur += 4) {
+    __m128i v = _mm_loadu_si128((__m128i *)&buf[cur]);
+    // All 4 alphas are 255, only bytes move
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, opaque), opaque)) ==
+        0xffff) {
+      _mm_storeu_si128((__m128i *)&buf[cur], _mm_shuffle_epi8(v, shuffle));
+    } else {
+      buf[cur + 0] = argb2rgba_pixel(buf[cur + 0]);
+      buf[cur + 1] = argb2rgba_pixel(buf[cur + 1]);
+      buf[cur + 2] = argb2rgba_pixel(buf[cur + 2]);
+      buf[cur + 3] = argb2rgba_pixel(buf[cur + 3]);
+    }
+  }
+  for (; cur < len; cur++) {
+    buf[cur] = argb2rgba_pixel(buf[cur]);
+  }
+}
+
+__attribute__((target("avx2"))) static void argb2rgba_avx2(uint32_t *buf,
+                                                           int len) {
+  const __m256i shuffle =
+      _mm256_setr_epi8(ARGB2RGBA_SHUFFLE, ARGB2RGBA_SHUFFLE);
+  const __m256i opaque = _mm256_set1_epi32(0xff000000);
+  const __m256i mask = _mm256_set1_epi32(0xff);
+  const __m256i zero = _mm256_setzero_si256();
+  int64_t cur;
+  for (cur = 0; cur + 7 < len; cur += 8) {
+    __m256i v = _mm256_loadu_si256((__m256i *)&buf[cur]);
+    // All 8 alphas are 255, only bytes move
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(
+            _mm256_and_si256(v, opaque), opaque)) == -1) {
+      _mm256_storeu_si256((__m256i *)&buf[cur],
+                          _mm256_shuffle_epi8(v, shuffle));
+      continue;
+    }
+    // Un-premultiply with the reciprocal table, alpha 0 is left as is
+    __m256i a = _mm256_srli_epi32(v, 24);
+    __m256i m = _mm256_i32gather_epi32((const int *)unpremultiply_table, a, 4);
+    __m256i r = _mm256_and_si256(_mm256_srli_epi32(v, 16), mask);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(v, 8), mask);
+    __m256i b = _mm256_and_si256(v, mask);
+    r = _mm256_and_si256(_mm256_srli_epi32(_mm256_mullo_epi32(r, m), 16), mask);
+    g = _mm256_and_si256(_mm256_srli_epi32(_mm256_mullo_epi32(g, m), 16), mask);
+    b = _mm256_and_si256(_mm256_srli_epi32(_mm256_mullo_epi32(b, m), 16), mask);
+    __m256i out = _mm256_or_si256(
+        _mm256_or_si256(_mm256_slli_epi32(a, 24), _mm256_slli_epi32(b, 16)),
+        _mm256_or_si256(_mm256_slli_epi32(g, 8), r));
+    out = _mm256_blendv_epi8(out, v, _mm256_cmpeq_epi32(a, zero));
+    _mm256_storeu_si256((__m256i *)&buf[cur], out);
+  }
+  for (; cur < len; cur++) {
+    buf[cur] = argb2rgba_pixel(buf[cur]);
+  }
+}
+
+// 0 -> scalar, 1 -> ssse3, 2 -> avx2
+static int argb2rgba_level;
+
+static int argb2rgba_supported(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2")    ? 2
+         : __builtin_cpu_supports("ssse3") ? 1
+                                           : 0;
+}
+
+// Detected once at load, before any reader thread exists, so argb2rgba only
+// ever reads it
+__attribute__((constructor)) static void argb2rgba_detect(void) {
+  argb2rgba_level = argb2rgba_supported();
+}
+
+#endif // OPS_SIMD
+
+int argb2rgba_set_level(int level) {
+#ifdef OPS_SIMD
+  int supported = argb2rgba_supported();
+  argb2rgba_level = MAX(MIN(level, supported), 0);
+  return argb2rgba_level;
+#else
+  (void)level;
+  return 0;
+#endif
+}
+
+void argb2rgba(uint32_t *buf, int len) {
+#ifdef OPS_SIMD
+  switch (argb2rgba_level) {
+  case 2:
+    argb2rgba_avx2(buf, len);
+    return;
+  case 1:
+    argb2rgba_ssse3(buf, len);
+    return;
+  }
+#endif
+  argb2rgba_scalar(buf, len);
+}
+
+void fill_uint32(uint32_t *buf, int64_t len, uint32_t value) {
+  int64_t cur = 0;
+#ifdef OPS_SIMD
+  // SSE2 is always there on x86_64, 64 bytes per iteration
+  const __m128i v = _mm_set1_epi32(value);
+  for (; cur + 15 < len; cur += 16) {
+    _mm_storeu_si128((__m128i *)&buf[cur + 0], v);
+    _mm_storeu_si128((__m128i *)&buf[cur + 4], v);
+    _mm_storeu_si128((__m128i *)&buf[cur + 8], v);
+    _mm_storeu_si128((__m128i *)&buf[cur + 12], v);
+  }
+#endif
+  for (; cur < len; cur++) {
+    buf[cur] = value;
+  }
+}
+
+void fill_rgb(uint8_t *buf, int64_t len, uint8_t r, uint8_t g, uint8_t b) {
+  // 16 pixels, 48 bytes: whole pixels and whole 16 byte stores
+  uint8_t pattern[48];
+  for (int i = 0; i < 16; i++) {
+    pattern[i * 3 + 0] = r;
+    pattern[i * 3 + 1] = g;
+    pattern[i * 3 + 2] = b;
+  }
+  int64_t cur = 0;
+#ifdef OPS_SIMD
+  const __m128i v0 = _mm_loadu_si128((const __m128i *)&pattern[0]);
+  const __m128i v1 = _mm_loadu_si128((const __m128i *)&pattern[16]);
+  const __m128i v2 = _mm_loadu_si128((const __m128i *)&pattern[32]);
+  for (; cur + 15 < len; cur += 16) {
+    _mm_storeu_si128((__m128i *)&buf[cur * 3 + 0], v0);
+    _mm_storeu_si128((__m128i *)&buf[cur * 3 + 16], v1);
+    _mm_storeu_si128((__m128i *)&buf[cur * 3 + 32], v2);
+  }
+#else
+  for (; cur + 15 < len; cur += 16) {
+    memcpy(&buf[cur * 3], pattern, sizeof(pattern));
+  }
+#endif
+  for (; cur < len; cur++) {
+    buf[cur * 3 + 0] = r;
+    buf[cur * 3 + 1] = g;
+    buf[cur * 3 + 2] = b;
+  }
+}
+
+int64_t image_bytes(image_t *image) {
+  int64_t pixels = (int64_t)image->width * image->height;
+  return image->format == IMAGE_RGBA ? pixels * 4 : pixels * 3;
+}
+
+// c + a * b / 255, rounded ( Pillow's MULDIV255 ), clipped: resampled
+// premultiplied colour can ring slightly above its alpha
+static inline uint8_t over255(unsigned int c, unsigned int a, unsigned int b) {
+  unsigned int tmp = a * b + 128;
+  tmp = c + (((tmp >> 8) + tmp) >> 8);
+  return tmp > 255 ? 255 : tmp;
+}
+
+void rgba2rgb_over(uint8_t *rgb, const uint8_t *rgba, int len,
+                   uint32_t background) {
+  unsigned int r = background >> 16 & 0xff, g = background >> 8 & 0xff,
+               b = background & 0xff;
+  for (int i = 0; i < len; i++, rgba += 4, rgb += 3) {
+    unsigned int t = 255 - rgba[3];
+    rgb[0] = over255(rgba[0], r, t);
+    rgb[1] = over255(rgba[1], g, t);
+    rgb[2] = over255(rgba[2], b, t);
+  }
+}
+
+void rgba2planar_over(uint8_t *r, uint8_t *g, uint8_t *b, const uint8_t *rgba,
+                      int len, uint32_t background) {
+  unsigned int br = background >> 16 & 0xff, bg = background >> 8 & 0xff,
+               bb = background & 0xff;
+  for (int i = 0; i < len; i++, rgba += 4) {
+    unsigned int t = 255 - rgba[3];
+    r[i] = over255(rgba[0], br, t);
+    g[i] = over255(rgba[1], bg, t);
+    b[i] = over255(rgba[2], bb, t);
+  }
+}
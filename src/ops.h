@@ -23,5 +23,34 @@ dpos_t _div(dpos_t a, double b);
 dpos_t _addv(dpos_t a, dpos_t b);
 dpos_t _subv(dpos_t a, dpos_t b);
 
+// Ratios, reduced. Products of two stay within int64_t for slide sizes
+rational_t rational(int64_t num, int64_t den);
+rational_t rational_mul(rational_t a, rational_t b);
+double rational_double(rational_t a);
+// Closest ratio with den <= max_den ( continued fractions ): 0.2495 ->
+// 499 / 2000
+rational_t rational_from_double(double x, int64_t max_den);
+
 // From openslide-python _convert.c
+// SIMD when available, opaque pixels are a single byte shuffle
 void argb2rgba(uint32_t *buf, int len);
+void argb2rgba_scalar(uint32_t *buf, int len); // reference
+// Cap the level used ( 0 scalar, 1 ssse3, 2 avx2 ), e.g. to test each
+// kernel. Returns the level actually in use, never above what the cpu
+// supports. NOTE: Not thread safe, set before converting from threads
+int argb2rgba_set_level(int level);
+
+// Fill with a pixel value, SIMD when available ( memset for uint32 )
+void fill_uint32(uint32_t *buf, int64_t len, uint32_t value);
+// Same, len packed RGB pixels, 16 at a time
+void fill_rgb(uint8_t *buf, int64_t len, uint8_t r, uint8_t g, uint8_t b);
+
+// Bytes of image data, for its format
+int64_t image_bytes(image_t *image);
+
+// Premultiplied RGBa -> RGB composited over background ( 0xRRGGBB ), as
+// c + background * ( 255 - a ) / 255: packed, or one row into each plane
+void rgba2rgb_over(uint8_t *rgb, const uint8_t *rgba, int len,
+                   uint32_t background);
+void rgba2planar_over(uint8_t *r, uint8_t *g, uint8_t *b, const uint8_t *rgba,
+                      int len, uint32_t background);
@@ -1,7 +1,11 @@
 #include "resize.h"
+#include "ops.h"
+#include "resize/resample.h"
+#include "trace.h"
 
 int image_resize(image_t *out, image_t *in, ipos_t size,
                  VipsKernel resampling) {
+  TRACE_BEGIN(span);
   VipsImage *img = vips_image_new_from_memory(
       in->data, (in->width * in->height * in->bands), in->width, in->height,
       in->bands, VIPS_FORMAT_CHAR);
@@ -19,6 +23,7 @@ int image_resize(image_t *out, image_t *in, ipos_t size,
   out->bands = in->bands;
   out->data = (uint32_t *)rsz->data;
 
+  TRACE_END(span, TRACE_RESIZE);
   return err;
 }
 
@@ -41,3 +46,170 @@ int image_rescale(image_t *out, image_t *in, double scaling,
   out->data = (uint32_t *)rsz->data;
   return err;
 }
+
+// Wrap rows of image as Imaging, without copying. Data must outlive it.
+static Imaging imaging_wrap(image_t *image, const char *mode) {
+  Imaging im = ImagingNewPrologue(mode, image->width, image->height);
+  if (!im) {
+    return NULL;
+  }
+  for (int y = 0; y < image->height; y++) {
+    im->image[y] = (char *)(image->data + (int64_t)y * image->width);
+  }
+  return im;
+}
+
+// Row y of out from a premultiplied RGBa line, in out's format
+static void image_store_row(image_t *out, int y, UINT8 *line) {
+  int64_t offset = (int64_t)y * out->width;
+  uint8_t *bytes = (uint8_t *)out->data;
+  switch (out->format) {
+  case IMAGE_RGB:
+    rgba2rgb_over(bytes + offset * 3, line, out->width, out->background);
+    break;
+  case IMAGE_CHW: {
+    int64_t plane = (int64_t)out->width * out->height;
+    rgba2planar_over(bytes + offset, bytes + plane + offset,
+                     bytes + 2 * plane + offset, line, out->width,
+                     out->background);
+    break;
+  }
+  default:
+    // RGBa -> RGBA
+    rgba2rgbA((UINT8 *)(out->data + offset), line, out->width);
+  }
+}
+
+int image_resample(image_t *out, image_t *in, dbox_t box, int filter) {
+  float fbox[4] = {box.x1, box.y1, box.x2, box.y2};
+
+  Imaging imIn = imaging_wrap(in, "RGBA");
+  if (!imIn) {
+    return 1;
+  }
+
+  // RGBA -> RGBa, unless nearest ( see PIL Image.resize )
+  int premultiply = filter != IMAGING_TRANSFORM_NEAREST;
+  if (premultiply) {
+    TRACE_BEGIN(convert);
+    for (int y = 0; y < imIn->ysize; y++) {
+      rgbA2rgba((UINT8 *)imIn->image[y], (UINT8 *)imIn->image[y],
+                imIn->xsize);
+    }
+    TRACE_END(convert, TRACE_CONVERT);
+  }
+
+  Imaging imOut =
+      ImagingResample(imIn, out->width, out->height, filter, fbox);
+  ImagingDelete(imIn);
+  if (!imOut) {
+    return 1;
+  }
+
+  // Lines of imOut are not contiguous, copy them one by one
+  // RGBa -> out's format while copying
+  TRACE_BEGIN(convert);
+  for (int y = 0; y < out->height; y++) {
+    UINT8 *line = (UINT8 *)imOut->image[y];
+    if (premultiply) {
+      image_store_row(out, y, line);
+    } else if (out->format == IMAGE_RGBA) {
+      memcpy(out->data + (int64_t)y * out->width, line, imOut->linesize);
+    } else {
+      rgbA2rgba(line, line, imOut->xsize);
+      image_store_row(out, y, line);
+    }
+  }
+  TRACE_END(convert, TRACE_CONVERT);
+  out->bands = out->format == IMAGE_RGBA ? in->bands : 3;
+  ImagingDelete(imOut);
+
+  return 0;
+}
+
+int image_resample_argb(image_t *out, image_t *in, dbox_t box, int filter) {
+  float fbox[4] = {box.x1, box.y1, box.x2, box.y2};
+
+  // Premultiplied ARGB is BGRa in memory, the horizontal pass swizzles it
+  Imaging imIn = imaging_wrap(in, "BGRa");
+  if (!imIn) {
+    return 1;
+  }
+
+  Imaging imOut =
+      ImagingResample(imIn, out->width, out->height, filter, fbox);
+  ImagingDelete(imIn);
+  if (!imOut) {
+    return 1;
+  }
+
+  // RGBa -> out's format while copying
+  TRACE_BEGIN(convert);
+  for (int y = 0; y < out->height; y++) {
+    image_store_row(out, y, (UINT8 *)imOut->image[y]);
+  }
+  TRACE_END(convert, TRACE_CONVERT);
+  out->bands = out->format == IMAGE_RGBA ? 4 : 3;
+  ImagingDelete(imOut);
+
+  return 0;
+}
+
+struct image_resample_stream_t {
+  image_t *out;
+  int rows;
+  ImagingResampleStream stream;
+};
+
+// RGBa -> out's format, into the row of out
+static int stream_emit(void *arg, int y, UINT8 *line) {
+  image_resample_stream_t *stream = arg;
+  image_store_row(stream->out, y, line);
+  stream->rows = y + 1;
+  return 0;
+}
+
+image_resample_stream_t *image_resample_stream_new(image_t *out,
+                                                   ipos_t in_size, dbox_t box,
+                                                   int filter) {
+  float fbox[4] = {box.x1, box.y1, box.x2, box.y2};
+  image_resample_stream_t *stream = calloc(1, sizeof(image_resample_stream_t));
+  if (!stream) {
+    return NULL;
+  }
+  stream->out = out;
+  stream->stream =
+      ImagingResampleStreamNew("BGRa", in_size.x, in_size.y, out->width,
+                               out->height, filter, fbox, stream_emit, stream);
+  if (!stream->stream) {
+    free(stream);
+    return NULL;
+  }
+  out->bands = out->format == IMAGE_RGBA ? 4 : 3;
+  return stream;
+}
+
+void image_resample_stream_free(image_resample_stream_t *stream) {
+  if (!stream) {
+    return;
+  }
+  ImagingResampleStreamDelete(stream->stream);
+  free(stream);
+}
+
+int image_resample_stream_push(image_resample_stream_t *stream,
+                               uint32_t *rows, int n) {
+  int width = stream->stream->inXsize;
+  for (int y = 0; y < n; y++) {
+    if (ImagingResampleStreamPush(stream->stream,
+                                  (UINT8 *)(rows + (int64_t)y * width)) < 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int image_resample_stream_rows(image_resample_stream_t *stream) {
+  return stream->rows;
+}
+
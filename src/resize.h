@@ -1,3 +1,4 @@
+#include "resize/imaging.h"
 #include "types.h"
 #include <stdlib.h>
 #include <vips/vips.h>
@@ -7,3 +8,63 @@
 int image_resize(image_t *out, image_t *in, ipos_t size, VipsKernel resampling);
 int image_rescale(image_t *out, image_t *in, double scaling,
                   VipsKernel resampling);
+
+// Pillow resample, with box support ( IMAGING_TRANSFORM_* filters )
+// Same as Image.resize: RGBA is resampled premultiplied ( RGBa ).
+// Written in out->format: RGBA, or RGB / CHW composited over out->background
+// while converting the last pass' rows.
+// NOTE: in->data is premultiplied in place
+// NOTE: out->data is expected to be allocated, of image_bytes(out)
+int image_resample(image_t *out, image_t *in, dbox_t box, int filter);
+
+// Coefficients of both passes are cached across calls, see
+// resize/resample_coeffs.h. Disabling also empties the cache.
+int ImagingResampleCoeffsSetCache(int enabled);
+void ImagingResampleCoeffsStats(int64_t *hits, int64_t *misses);
+
+// Reduce-then-resample for large downsamples: box-reduce by the largest
+// integer factor leaving at least gap times the output size ( SSE2 for 2x2
+// and 4x4 ), then Lanczos on the small intermediate. 0 -> direct ( default ),
+// same as Pillow's reducing_gap. At gap >= 2, outputs of smooth ( tissue
+// like ) content stay within 4 levels of the direct path, under 0.5 on
+// average ( see test-resample.c ); a lower gap is faster, and further off.
+// Returns the previous gap.
+// NOTE: Set before reading from threads
+double ImagingResampleSetReducingGap(double gap);
+
+// Both resample passes split in row bands over threads ( calling one
+// included ) of a persistent pool, for large regions: passes under 128x128
+// output pixels, or started while the pool is busy, stay serial. Same
+// output. threads <= 1 -> serial ( default ), stops the pool. Returns the
+// number of threads in use.
+// NOTE: Set before reading from threads
+int ImagingResampleSetThreads(int threads);
+
+// Same, straight from openslide's premultiplied ARGB: no argb2rgba pass.
+// Exact with image_resample after argb2rgba when alpha is 0 or 255; partial
+// alpha skips the un/re-premultiply round trip, so may differ by rounding.
+// NOTE: little endian only ( ARGB is BGRa in memory )
+int image_resample_argb(image_t *out, image_t *in, dbox_t box, int filter);
+
+// Row streaming image_resample_argb: rows of ARGB are pushed in order, and
+// rows of out are written ( RGBA ) as soon as their vertical support is in.
+// Peak memory is a ring of filter support rows of out->width, instead of the
+// whole padded input and horizontal pass. Same output as image_resample_argb.
+// NOTE: little endian only, see image_resample_argb
+// NOTE: out->data is expected to be allocated
+typedef struct image_resample_stream_t image_resample_stream_t;
+
+// NOTE: Remember to free
+image_resample_stream_t *image_resample_stream_new(image_t *out,
+                                                   ipos_t in_size, dbox_t box,
+                                                   int filter);
+void image_resample_stream_free(image_resample_stream_t *stream);
+
+// n rows of in_size.x ARGB pixels. Returns non zero on error, or past the
+// last input row
+int image_resample_stream_push(image_resample_stream_t *stream,
+                               uint32_t *rows, int n);
+
+// Rows of out written so far
+int image_resample_stream_rows(image_resample_stream_t *stream);
+
@@ -0,0 +1,47 @@
+/*
+ * The Python Imaging Library
+ * $Id$
+ *
+ * convert images
+ *
+ * NOTE: Only the RGBA <-> RGBa conversions used by Image.resize are ported.
+ *
+ * Copyright (c) 1997-2005 by Secret Labs AB.
+ * Copyright (c) 1995-1997 by Fredrik Lundh.
+ *
+ * See the README file for details on usage and redistribution.
+ */
+
+#include "imaging.h"
+
+void rgbA2rgba(UINT8 *out, const UINT8 *in, int xsize) {
+  int x;
+  unsigned int alpha, tmp;
+  for (x = 0; x < xsize; x++) {
+    alpha = in[3];
+    *out++ = MULDIV255(*in++, alpha, tmp);
+    *out++ = MULDIV255(*in++, alpha, tmp);
+    *out++ = MULDIV255(*in++, alpha, tmp);
+    *out++ = *in++;
+  }
+}
+
+/* RGBa -> RGBA conversion to remove premultiplication
+   Needed for correct transforms/resizing on RGBA images */
+void rgba2rgbA(UINT8 *out, const UINT8 *in, int xsize) {
+  int x;
+  unsigned int alpha;
+  for (x = 0; x < xsize; x++, in += 4) {
+    alpha = in[3];
+    if (alpha == 255 || alpha == 0) {
+      *out++ = in[0];
+      *out++ = in[1];
+      *out++ = in[2];
+    } else {
+      *out++ = CLIP8((255 * in[0]) / alpha);
+      *out++ = CLIP8((255 * in[1]) / alpha);
+      *out++ = CLIP8((255 * in[2]) / alpha);
+    }
+    *out++ = in[3];
+  }
+}
@@ -15,7 +15,9 @@
  * See the README file for details on usage and redistribution.
  */
 
-#include "utils.h"
+#include "except.h"
+#include "imaging.h"
+#include <string.h>
 
 static Imaging _copy(Imaging imOut, Imaging imIn) {
   int y;
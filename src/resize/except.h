@@ -1,6 +1,8 @@
+#pragma once
+
 #include <stdio.h>
 
-void *ImagingError_ValueError(const char *message) {
+static inline void *ImagingError_ValueError(const char *message) {
   if (!message) {
     message = "exception: bad argument to function";
   }
@@ -8,24 +10,24 @@ void *ImagingError_ValueError(const char *message) {
   return NULL;
 }
 
-void *ImagingError_Mismatch(void) {
+static inline void *ImagingError_Mismatch(void) {
   return ImagingError_ValueError("images don't match");
 }
 
-void *ImagingError_ModeError(void) {
+static inline void *ImagingError_ModeError(void) {
   return ImagingError_ValueError("bad image mode");
 }
 
-void *ImagingError_OSError(void) {
+static inline void *ImagingError_OSError(void) {
   fprintf(stderr, "*** exception: file access error\n");
   return NULL;
 }
 
-void *ImagingError_MemoryError(void) {
+static inline void *ImagingError_MemoryError(void) {
   fprintf(stderr, "*** exception: out of memory\n");
   return NULL;
 }
 
-void ImagingError_Clear(void) { /* nop */
+static inline void ImagingError_Clear(void) { /* nop */
   ;
 }
@@ -1,4 +1,7 @@
+#pragma once
+
 #include "platform.h"
+#include <pthread.h>
 
 typedef struct {
   char *ptr;
@@ -18,6 +21,8 @@ typedef struct ImagingMemoryArena {
   int stats_reallocated_blocks; /* Number of blocks which were actually
                                    reallocated after retrieving */
   int stats_freed_blocks;       /* Number of freed blocks */
+  pthread_mutex_t mutex; /* Guards pool and stats, arenas may be shared */
+  int blocks_grow_only;  /* Pooled blocks are only reallocated to grow */
 } *ImagingMemoryArena;
 
 typedef struct ImagingMemoryInstance *Imaging;
@@ -53,6 +58,7 @@ struct ImagingMemoryInstance {
   char **image;               /* Actual raster data. */
   char *block;                /* Set if data is allocated in a single block. */
   ImagingMemoryBlock *blocks; /* Memory blocks for pixel storage */
+  ImagingMemoryArena arena;   /* Arena the blocks are returned to */
 
   int pixelsize; /* Size of a pixel, in bytes (1, 2 or 4) */
   int linesize;  /* Size of a line, in bytes (xsize * pixelsize) */
@@ -61,6 +67,14 @@ struct ImagingMemoryInstance {
   void (*destroy)(Imaging im);
 };
 
+/* standard filters */
+#define IMAGING_TRANSFORM_NEAREST 0
+#define IMAGING_TRANSFORM_BOX 4
+#define IMAGING_TRANSFORM_BILINEAR 2
+#define IMAGING_TRANSFORM_HAMMING 5
+#define IMAGING_TRANSFORM_BICUBIC 3
+#define IMAGING_TRANSFORM_LANCZOS 1
+
 #define IMAGING_PIXEL_1(im, x, y) ((im)->image8[(y)][(x)])
 #define IMAGING_PIXEL_L(im, x, y) ((im)->image8[(y)][(x)])
 #define IMAGING_PIXEL_LA(im, x, y) ((im)->image[(y)][(x) * 4])
@@ -81,6 +95,22 @@ extern struct ImagingMemoryArena ImagingDefaultArena;
 extern int ImagingMemorySetBlocksMax(ImagingMemoryArena arena, int blocks_max);
 extern void ImagingMemoryClearCache(ImagingMemoryArena arena, int new_size);
 
+/* Arena of the calling thread, ImagingDefaultArena unless set. New images
+   take their blocks from it. */
+extern ImagingMemoryArena ImagingGetArena(void);
+extern void ImagingSetArena(ImagingMemoryArena arena);
+
+/* Arenas other than the default one, e.g. one per thread. Unlike the
+   default arena, their pooled blocks only grow ( blocks_grow_only ). */
+extern int ImagingMemoryArenaInit(ImagingMemoryArena arena, int blocks_max);
+extern void ImagingMemoryArenaRelease(ImagingMemoryArena arena);
+
+/* Raw blocks from an arena, for buffers that are not images */
+extern ImagingMemoryBlock ImagingMemoryGetBlock(ImagingMemoryArena arena,
+                                                int requested_size, int dirty);
+extern void ImagingMemoryReturnBlock(ImagingMemoryArena arena,
+                                     ImagingMemoryBlock block);
+
 extern Imaging ImagingNew(const char *mode, int xsize, int ysize);
 extern Imaging ImagingNewDirty(const char *mode, int xsize, int ysize);
 extern Imaging ImagingNew2Dirty(const char *mode, Imaging imOut, Imaging imIn);
@@ -93,3 +123,7 @@ extern Imaging ImagingNewPrologueSubtype(const char *mode, int xsize, int ysize,
                                          int structure_size);
 
 extern Imaging ImagingCopy(Imaging imIn);
+
+/* RGBA <-> RGBa, as done by Image.resize around resampling */
+extern void rgbA2rgba(UINT8 *out, const UINT8 *in, int xsize);
+extern void rgba2rgbA(UINT8 *out, const UINT8 *in, int xsize);
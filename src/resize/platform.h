@@ -9,6 +9,8 @@
 
 // --- From Pillow ImPlatform.h ---
 
+#pragma once
+
 #if defined(PIL_NO_INLINE)
 #define inline
 #else
@@ -134,5 +136,5 @@ static float __attribute__((always_inline)) inline _i2f(int v) {
   return x;
 }
 #else
-static float inline _i2f(int v) { return (float)v; }
+static inline float _i2f(int v) { return (float)v; }
 #endif
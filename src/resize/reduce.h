@@ -0,0 +1,143 @@
+// Box reduction by integer factors, as Pillow's Image.reduce, used by
+// ImagingResample ahead of large downsamples ( see reducing_gap ).
+//
+// Each output pixel is the rounded mean of a xscale x yscale cell of the
+// box; cells on the right and bottom edges may be partial, and are averaged
+// over the pixels they have. 2x2 and 4x4 cells have SSE2 kernels, exact with
+// the scalar ones. 4-band 8bpc only, bands are kept in order ( BGRa stays
+// BGRa, swizzled later by the horizontal pass ).
+// NOTE: Included from resample.h only, needs resample_simd.h
+
+/* Rounded mean of a w x h cell at (x0, y0) */
+static inline void reduce_cell(UINT8 *out, Imaging imIn, int x0, int y0, int w,
+                               int h) {
+  UINT32 ss0 = 0, ss1 = 0, ss2 = 0, ss3 = 0;
+  UINT32 n = w * h;
+  for (int y = y0; y < y0 + h; y++) {
+    UINT8 *line = (UINT8 *)imIn->image[y];
+    for (int x = x0; x < x0 + w; x++) {
+      ss0 += line[x * 4 + 0];
+      ss1 += line[x * 4 + 1];
+      ss2 += line[x * 4 + 2];
+      ss3 += line[x * 4 + 3];
+    }
+  }
+  out[0] = (ss0 + n / 2) / n;
+  out[1] = (ss1 + n / 2) / n;
+  out[2] = (ss2 + n / 2) / n;
+  out[3] = (ss3 + n / 2) / n;
+}
+
+/* Any cell size, outputs from column xx0 of rows yy0 to yy1 */
+static void ImagingReduceNxN(Imaging imOut, Imaging imIn, int xscale,
+                             int yscale, int box[4], int xx0, int yy0,
+                             int yy1) {
+  for (int yy = yy0; yy < yy1; yy++) {
+    int y0 = box[1] + yy * yscale;
+    int h = box[1] + box[3] - y0 < yscale ? box[1] + box[3] - y0 : yscale;
+    UINT8 *out = (UINT8 *)imOut->image[yy];
+    for (int xx = xx0; xx < imOut->xsize; xx++) {
+      int x0 = box[0] + xx * xscale;
+      int w = box[0] + box[2] - x0 < xscale ? box[0] + box[2] - x0 : xscale;
+      reduce_cell(&out[xx * 4], imIn, x0, y0, w, h);
+    }
+  }
+}
+
+#ifdef __SSE2__
+/* 2x2 cells, 2 at a time, whole pairs of cells only. Sets the outputs
+   done, the rest is left to ImagingReduceNxN. */
+static void ImagingReduce2x2_sse2(Imaging imOut, Imaging imIn, int box[4],
+                                  int *done_x, int *done_y) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi16(2);
+  int xsize = box[2] / 4 * 2; /* outputs with whole cells, pairs */
+  int ysize = box[3] / 2;
+  for (int yy = 0; yy < ysize; yy++) {
+    UINT8 *line0 = (UINT8 *)imIn->image[box[1] + yy * 2 + 0] + box[0] * 4;
+    UINT8 *line1 = (UINT8 *)imIn->image[box[1] + yy * 2 + 1] + box[0] * 4;
+    UINT8 *out = (UINT8 *)imOut->image[yy];
+    for (int xx = 0; xx < xsize; xx += 2) {
+      __m128i r0 = _mm_loadu_si128((__m128i *)&line0[xx * 8]);
+      __m128i r1 = _mm_loadu_si128((__m128i *)&line1[xx * 8]);
+      // Pixels 0 and 1, 2 and 3 of both rows, as 16 bit
+      __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(r0, zero),
+                                 _mm_unpacklo_epi8(r1, zero));
+      __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(r0, zero),
+                                 _mm_unpackhi_epi8(r1, zero));
+      __m128i ss = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi),
+                                 _mm_unpackhi_epi64(lo, hi));
+      ss = _mm_srli_epi16(_mm_add_epi16(ss, half), 2);
+      _mm_storel_epi64((__m128i *)&out[xx * 4], _mm_packus_epi16(ss, ss));
+    }
+  }
+  *done_x = xsize;
+  *done_y = ysize;
+}
+
+/* 4x4 cells, whole cells only */
+static void ImagingReduce4x4_sse2(Imaging imOut, Imaging imIn, int box[4],
+                                  int *done_x, int *done_y) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi16(8);
+  int xsize = box[2] / 4;
+  int ysize = box[3] / 4;
+  for (int yy = 0; yy < ysize; yy++) {
+    UINT8 *lines[4];
+    for (int r = 0; r < 4; r++) {
+      lines[r] = (UINT8 *)imIn->image[box[1] + yy * 4 + r] + box[0] * 4;
+    }
+    UINT8 *out = (UINT8 *)imOut->image[yy];
+    for (int xx = 0; xx < xsize; xx++) {
+      __m128i lo = zero, hi = zero;
+      for (int r = 0; r < 4; r++) {
+        __m128i v = _mm_loadu_si128((__m128i *)&lines[r][xx * 16]);
+        lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+        hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+      }
+      // At most 16 * 255, fits 16 bit
+      __m128i ss = _mm_add_epi16(lo, hi);
+      ss = _mm_add_epi16(ss, _mm_srli_si128(ss, 8));
+      ss = _mm_srli_epi16(_mm_add_epi16(ss, half), 4);
+      UINT32 v = _mm_cvtsi128_si32(_mm_packus_epi16(ss, ss));
+      memcpy(&out[xx * 4], &v, sizeof(v));
+    }
+  }
+  *done_x = xsize;
+  *done_y = ysize;
+}
+#endif
+
+/* Reduce box ( x0, y0, width, height ) of imIn by xscale, yscale, into a new
+   image of ceil( width / xscale ) x ceil( height / yscale ) */
+Imaging ImagingReduce(Imaging imIn, int xscale, int yscale, int box[4]) {
+  if (imIn->image8 || imIn->type != IMAGING_TYPE_UINT8 || imIn->bands != 4 ||
+      xscale < 1 || yscale < 1) {
+    return (Imaging)ImagingError_ModeError();
+  }
+  if (box[0] < 0 || box[1] < 0 || box[2] <= 0 || box[3] <= 0 ||
+      box[0] + box[2] > imIn->xsize || box[1] + box[3] > imIn->ysize) {
+    return (Imaging)ImagingError_ValueError("box can't exceed original image");
+  }
+
+  Imaging imOut = ImagingNewDirty(imIn->mode, (box[2] + xscale - 1) / xscale,
+                                  (box[3] + yscale - 1) / yscale);
+  if (!imOut) {
+    return NULL;
+  }
+
+  // Whole cells first, if there is a kernel for them, then the rest
+  int done_x = 0, done_y = 0;
+#ifdef __SSE2__
+  if (ImagingResampleGetSIMD() != RESAMPLE_SIMD_NONE) {
+    if (xscale == 2 && yscale == 2) {
+      ImagingReduce2x2_sse2(imOut, imIn, box, &done_x, &done_y);
+    } else if (xscale == 4 && yscale == 4) {
+      ImagingReduce4x4_sse2(imOut, imIn, box, &done_x, &done_y);
+    }
+  }
+#endif
+  ImagingReduceNxN(imOut, imIn, xscale, yscale, box, done_x, 0, done_y);
+  ImagingReduceNxN(imOut, imIn, xscale, yscale, box, 0, done_y, imOut->ysize);
+  return imOut;
+}
@@ -1,401 +1,23 @@
 #include "utils.h"
-
-//-------------------------------------------------------------------------
-//                    -- Memory stuff --
-//-------------------------------------------------------------------------
-
-Imaging ImagingNewPrologueSubtype(const char *mode, int xsize, int ysize,
-                                  int size) {
-  Imaging im;
-
-  /* linesize overflow check, roughly the current largest space req'd */
-  if (xsize > (INT_MAX / 4) - 1) {
-    return (Imaging)ImagingError_MemoryError();
-  }
-
-  im = (Imaging)calloc(1, size);
-  if (!im) {
-    return (Imaging)ImagingError_MemoryError();
-  }
-
-  /* Setup image descriptor */
-  im->xsize = xsize;
-  im->ysize = ysize;
-
-  im->type = IMAGING_TYPE_UINT8;
-
-  if (strcmp(mode, "1") == 0) {
-    /* 1-bit images */
-    im->bands = im->pixelsize = 1;
-    im->linesize = xsize;
-
-    // NOTE: removed "P" and "PA" modes ( palette )
-  } else if (strcmp(mode, "L") == 0) {
-    /* 8-bit grayscale (luminance) images */
-    im->bands = im->pixelsize = 1;
-    im->linesize = xsize;
-
-  } else if (strcmp(mode, "LA") == 0) {
-    /* 8-bit grayscale (luminance) with alpha */
-    im->bands = 2;
-    im->pixelsize = 4; /* store in image32 memory */
-    im->linesize = xsize * 4;
-
-  } else if (strcmp(mode, "La") == 0) {
-    /* 8-bit grayscale (luminance) with premultiplied alpha */
-    im->bands = 2;
-    im->pixelsize = 4; /* store in image32 memory */
-    im->linesize = xsize * 4;
-
-  } else if (strcmp(mode, "F") == 0) {
-    /* 32-bit floating point images */
-    im->bands = 1;
-    im->pixelsize = 4;
-    im->linesize = xsize * 4;
-    im->type = IMAGING_TYPE_FLOAT32;
-
-  } else if (strcmp(mode, "I") == 0) {
-    /* 32-bit integer images */
-    im->bands = 1;
-    im->pixelsize = 4;
-    im->linesize = xsize * 4;
-    im->type = IMAGING_TYPE_INT32;
-
-  } else if (strcmp(mode, "I;16") == 0 || strcmp(mode, "I;16L") == 0 ||
-             strcmp(mode, "I;16B") == 0 || strcmp(mode, "I;16N") == 0) {
-    /* EXPERIMENTAL */
-    /* 16-bit raw integer images */
-    im->bands = 1;
-    im->pixelsize = 2;
-    im->linesize = xsize * 2;
-    im->type = IMAGING_TYPE_SPECIAL;
-
-  } else if (strcmp(mode, "RGB") == 0) {
-    /* 24-bit true colour images */
-    im->bands = 3;
-    im->pixelsize = 4;
-    im->linesize = xsize * 4;
-
-  } else if (strcmp(mode, "BGR;15") == 0) {
-    /* EXPERIMENTAL */
-    /* 15-bit reversed true colour */
-    im->bands = 3;
-    im->pixelsize = 2;
-    im->linesize = (xsize * 2 + 3) & -4;
-    im->type = IMAGING_TYPE_SPECIAL;
-
-  } else if (strcmp(mode, "BGR;16") == 0) {
-    /* EXPERIMENTAL */
-    /* 16-bit reversed true colour */
-    im->bands = 3;
-    im->pixelsize = 2;
-    im->linesize = (xsize * 2 + 3) & -4;
-    im->type = IMAGING_TYPE_SPECIAL;
-
-  } else if (strcmp(mode, "BGR;24") == 0) {
-    /* EXPERIMENTAL */
-    /* 24-bit reversed true colour */
-    im->bands = 3;
-    im->pixelsize = 3;
-    im->linesize = (xsize * 3 + 3) & -4;
-    im->type = IMAGING_TYPE_SPECIAL;
-
-  } else if (strcmp(mode, "RGBX") == 0) {
-    /* 32-bit true colour images with padding */
-    im->bands = im->pixelsize = 4;
-    im->linesize = xsize * 4;
-
-  } else if (strcmp(mode, "RGBA") == 0) {
-    /* 32-bit true colour images with alpha */
-    im->bands = im->pixelsize = 4;
-    im->linesize = xsize * 4;
-
-  } else if (strcmp(mode, "RGBa") == 0) {
-    /* 32-bit true colour images with premultiplied alpha */
-    im->bands = im->pixelsize = 4;
-    im->linesize = xsize * 4;
-
-  } else if (strcmp(mode, "CMYK") == 0) {
-    /* 32-bit colour separation */
-    im->bands = im->pixelsize = 4;
-    im->linesize = xsize * 4;
-
-  } else if (strcmp(mode, "YCbCr") == 0) {
-    /* 24-bit video format */
-    im->bands = 3;
-    im->pixelsize = 4;
-    im->linesize = xsize * 4;
-
-  } else if (strcmp(mode, "LAB") == 0) {
-    /* 24-bit color, luminance, + 2 color channels */
-    /* L is uint8, a,b are int8 */
-    im->bands = 3;
-    im->pixelsize = 4;
-    im->linesize = xsize * 4;
-
-  } else if (strcmp(mode, "HSV") == 0) {
-    /* 24-bit color, luminance, + 2 color channels */
-    /* L is uint8, a,b are int8 */
-    im->bands = 3;
-    im->pixelsize = 4;
-    im->linesize = xsize * 4;
-
-  } else {
-    free(im);
-    return (Imaging)ImagingError_ValueError("unrecognized image mode");
-  }
-
-  /* Setup image descriptor */
-  strcpy(im->mode, mode);
-
-  /* Pointer array (allocate at least one line, to avoid MemoryError
-     exceptions on platforms where calloc(0, x) returns NULL) */
-  im->image = (char **)calloc((ysize > 0) ? ysize : 1, sizeof(void *));
-
-  if (!im->image) {
-    free(im);
-    return (Imaging)ImagingError_MemoryError();
-  }
-
-  /* Initialize alias pointers to pixel data. */
-  switch (im->pixelsize) {
-  case 1:
-  case 2:
-  case 3:
-    im->image8 = (UINT8 **)im->image;
-    break;
-  case 4:
-    im->image32 = (INT32 **)im->image;
-    break;
-  }
-
-  ImagingDefaultArena.stats_new_count += 1;
-
-  return im;
-}
-
-Imaging ImagingNewPrologue(const char *mode, int xsize, int ysize) {
-  return ImagingNewPrologueSubtype(mode, xsize, ysize,
-                                   sizeof(struct ImagingMemoryInstance));
-}
-
-void ImagingDelete(Imaging im) {
-  if (!im) {
-    return;
-  }
-
-  // NOTE: removed free for im->palette
-
-  if (im->destroy) {
-    im->destroy(im);
-  }
-
-  if (im->image) {
-    free(im->image);
-  }
-
-  free(im);
-}
-
-#define IMAGING_PAGE_SIZE (4096)
-
-struct ImagingMemoryArena ImagingDefaultArena = {
-    1,                // alignment
-    16 * 1024 * 1024, // block_size
-    0,                // blocks_max
-    0,                // blocks_cached
-    NULL,             // blocks_pool
-    0,
-    0,
-    0,
-    0,
-    0 // Stats
-};
-
-int ImagingMemorySetBlocksMax(ImagingMemoryArena arena, int blocks_max) {
-  void *p;
-  /* Free already cached blocks */
-  ImagingMemoryClearCache(arena, blocks_max);
-
-  if (blocks_max == 0 && arena->blocks_pool != NULL) {
-    free(arena->blocks_pool);
-    arena->blocks_pool = NULL;
-  } else if (arena->blocks_pool != NULL) {
-    p = realloc(arena->blocks_pool, sizeof(*arena->blocks_pool) * blocks_max);
-    if (!p) {
-      // Leave previous blocks_max value
-      return 0;
-    }
-    arena->blocks_pool = p;
-  } else {
-    arena->blocks_pool = calloc(sizeof(*arena->blocks_pool), blocks_max);
-    if (!arena->blocks_pool) {
-      return 0;
-    }
-  }
-  arena->blocks_max = blocks_max;
-
-  return 1;
-}
-
-void ImagingMemoryClearCache(ImagingMemoryArena arena, int new_size) {
-  while (arena->blocks_cached > new_size) {
-    arena->blocks_cached -= 1;
-    free(arena->blocks_pool[arena->blocks_cached].ptr);
-    arena->stats_freed_blocks += 1;
-  }
-}
-
-ImagingMemoryBlock memory_get_block(ImagingMemoryArena arena,
-                                    int requested_size, int dirty) {
-  ImagingMemoryBlock block = {NULL, 0};
-
-  if (arena->blocks_cached > 0) {
-    // Get block from cache
-    arena->blocks_cached -= 1;
-    block = arena->blocks_pool[arena->blocks_cached];
-    // Reallocate if needed
-    if (block.size != requested_size) {
-      block.ptr = realloc(block.ptr, requested_size);
-    }
-    if (!block.ptr) {
-      // Can't allocate, free previous pointer (it is still valid)
-      free(arena->blocks_pool[arena->blocks_cached].ptr);
-      arena->stats_freed_blocks += 1;
-      return block;
-    }
-    if (!dirty) {
-      memset(block.ptr, 0, requested_size);
-    }
-    arena->stats_reused_blocks += 1;
-    if (block.ptr != arena->blocks_pool[arena->blocks_cached].ptr) {
-      arena->stats_reallocated_blocks += 1;
-    }
-  } else {
-    if (dirty) {
-      block.ptr = malloc(requested_size);
-    } else {
-      block.ptr = calloc(1, requested_size);
-    }
-    arena->stats_allocated_blocks += 1;
-  }
-  block.size = requested_size;
-  return block;
-}
-
-void memory_return_block(ImagingMemoryArena arena, ImagingMemoryBlock block) {
-  if (arena->blocks_cached < arena->blocks_max) {
-    // Reduce block size
-    if (block.size > arena->block_size) {
-      block.size = arena->block_size;
-      block.ptr = realloc(block.ptr, arena->block_size);
-    }
-    arena->blocks_pool[arena->blocks_cached] = block;
-    arena->blocks_cached += 1;
-  } else {
-    free(block.ptr);
-    arena->stats_freed_blocks += 1;
-  }
-}
-
-static void ImagingDestroyArray(Imaging im) {
-  int y = 0;
-
-  if (im->blocks) {
-    while (im->blocks[y].ptr) {
-      memory_return_block(&ImagingDefaultArena, im->blocks[y]);
-      y += 1;
-    }
-    free(im->blocks);
-  }
-}
-
-Imaging ImagingAllocateArray(Imaging im, int dirty, int block_size) {
-  int y, line_in_block, current_block;
-  ImagingMemoryArena arena = &ImagingDefaultArena;
-  ImagingMemoryBlock block = {NULL, 0};
-  int aligned_linesize, lines_per_block, blocks_count;
-  char *aligned_ptr = NULL;
-
-  /* 0-width or 0-height image. No need to do anything */
-  if (!im->linesize || !im->ysize) {
-    return im;
-  }
-
-  aligned_linesize = (im->linesize + arena->alignment - 1) & -arena->alignment;
-  lines_per_block = (block_size - (arena->alignment - 1)) / aligned_linesize;
-  if (lines_per_block == 0) {
-    lines_per_block = 1;
-  }
-  blocks_count = (im->ysize + lines_per_block - 1) / lines_per_block;
-  // printf("NEW size: %dx%d, ls: %d, lpb: %d, blocks: %d\n",
-  //        im->xsize, im->ysize, aligned_linesize, lines_per_block,
-  //        blocks_count);
-
-  /* One extra pointer is always NULL */
-  im->blocks = calloc(sizeof(*im->blocks), blocks_count + 1);
-  if (!im->blocks) {
-    return (Imaging)ImagingError_MemoryError();
-  }
-
-  /* Allocate image as an array of lines */
-  line_in_block = 0;
-  current_block = 0;
-  for (y = 0; y < im->ysize; y++) {
-    if (line_in_block == 0) {
-      int required;
-      int lines_remaining = lines_per_block;
-      if (lines_remaining > im->ysize - y) {
-        lines_remaining = im->ysize - y;
-      }
-      required = lines_remaining * aligned_linesize + arena->alignment - 1;
-      block = memory_get_block(arena, required, dirty);
-      if (!block.ptr) {
-        ImagingDestroyArray(im);
-        return (Imaging)ImagingError_MemoryError();
-      }
-      im->blocks[current_block] = block;
-      /* Bulletproof code from libc _int_memalign */
-      aligned_ptr = (char *)(((size_t)(block.ptr + arena->alignment - 1)) &
-                             -((__ssize_t)arena->alignment));
-    }
-
-    im->image[y] = aligned_ptr + aligned_linesize * line_in_block;
-
-    line_in_block += 1;
-    if (line_in_block >= lines_per_block) {
-      /* Reset counter and start new block */
-      line_in_block = 0;
-      current_block += 1;
-    }
-  }
-
-  im->destroy = ImagingDestroyArray;
-
-  return im;
-}
+#include "resample_simd.h"
+#include "resample_coeffs.h"
+#include "reduce.h"
+#include "../trace.h"
 
 //-------------------------------------------------------------------------
 //                    -- Actual resize stuff --
 //-------------------------------------------------------------------------
 
-/* standard filters */
-#define IMAGING_TRANSFORM_NEAREST 0
-#define IMAGING_TRANSFORM_BOX 4
-#define IMAGING_TRANSFORM_BILINEAR 2
-#define IMAGING_TRANSFORM_HAMMING 5
-#define IMAGING_TRANSFORM_BICUBIC 3
-#define IMAGING_TRANSFORM_LANCZOS 1
-
 void ImagingResampleHorizontal_8bpc(Imaging imOut, Imaging imIn, int offset,
                                     int ksize, int *bounds, double *prekk) {
   int ss0, ss1, ss2, ss3;
   int xx, yy, x, xmin, xmax;
   INT32 *k, *kk;
+  // BGRa ( openslide ARGB ) is written as RGBa
+  int bgra = strcmp(imIn->mode, "BGRa") == 0;
 
-  // use the same buffer for normalized coefficients
+  // coefficients are normalized by ImagingResampleInner
   kk = (INT32 *)prekk;
-  normalize_coeffs_8bpc(imOut->xsize, ksize, prekk);
 
   if (imIn->image8) {
     for (yy = 0; yy < imOut->ysize; yy++) {
@@ -458,7 +80,11 @@ void ImagingResampleHorizontal_8bpc(Imaging imOut, Imaging imIn, int offset,
             ss2 += ((UINT8)imIn->image[yy + offset][(x + xmin) * 4 + 2]) * k[x];
             ss3 += ((UINT8)imIn->image[yy + offset][(x + xmin) * 4 + 3]) * k[x];
           }
-          v = MAKE_UINT32(clip8(ss0), clip8(ss1), clip8(ss2), clip8(ss3));
+          if (bgra) {
+            v = MAKE_UINT32(clip8(ss2), clip8(ss1), clip8(ss0), clip8(ss3));
+          } else {
+            v = MAKE_UINT32(clip8(ss0), clip8(ss1), clip8(ss2), clip8(ss3));
+          }
           memcpy(imOut->image[yy] + xx * sizeof(v), &v, sizeof(v));
         }
       }
@@ -472,9 +98,11 @@ void ImagingResampleVertical_8bpc(Imaging imOut, Imaging imIn, int offset,
   int xx, yy, y, ymin, ymax;
   INT32 *k, *kk;
 
-  // use the same buffer for normalized coefficients
+  // Unused, as in Pillow: kept for the ResampleFunction signature
+  (void)offset;
+
+  // coefficients are normalized by ImagingResampleInner
   kk = (INT32 *)prekk;
-  normalize_coeffs_8bpc(imOut->ysize, ksize, prekk);
 
   if (imIn->image8) {
     for (yy = 0; yy < imOut->ysize; yy++) {
@@ -590,6 +218,9 @@ void ImagingResampleVertical_32bpc(Imaging imOut, Imaging imIn, int offset,
   int xx, yy, y, ymin, ymax;
   double *k;
 
+  // Unused, as in Pillow: kept for the ResampleFunction signature
+  (void)offset;
+
   switch (imIn->type) {
   case IMAGING_TYPE_INT32:
     for (yy = 0; yy < imOut->ysize; yy++) {
@@ -626,11 +257,66 @@ void ImagingResampleVertical_32bpc(Imaging imOut, Imaging imIn, int offset,
 typedef void (*ResampleFunction)(Imaging imOut, Imaging imIn, int offset,
                                  int ksize, int *bounds, double *kk);
 
+#include "resample_pool.h"
+
 Imaging ImagingResampleInner(Imaging imIn, int xsize, int ysize,
                              struct filter *filterp, float box[4],
                              ResampleFunction ResampleHorizontal,
                              ResampleFunction ResampleVertical);
 
+/* Box-reduce first by the largest integer factor leaving at least gap times
+   the output size, as Pillow's reducing_gap; 0 -> never. */
+static double resample_reducing_gap = 0.0;
+
+/* Returns the previous gap. NOTE: Set before resampling from threads */
+double ImagingResampleSetReducingGap(double gap) {
+  double previous = resample_reducing_gap;
+  resample_reducing_gap = gap > 0.0 ? gap : 0.0;
+  return previous;
+}
+
+/* Filter of an IMAGING_TRANSFORM_* constant, NULL if unsupported */
+static struct filter *resample_filter(int filter) {
+  switch (filter) {
+  case IMAGING_TRANSFORM_BOX:
+    return &BOX;
+  case IMAGING_TRANSFORM_BILINEAR:
+    return &BILINEAR;
+  case IMAGING_TRANSFORM_HAMMING:
+    return &HAMMING;
+  case IMAGING_TRANSFORM_BICUBIC:
+    return &BICUBIC;
+  case IMAGING_TRANSFORM_LANCZOS:
+    return &LANCZOS;
+  }
+  return NULL;
+}
+
+/* Passes for 8bpc images, SIMD for 4 bands when available */
+static void resample_functions_8bpc(int bands,
+                                    ResampleFunction *ResampleHorizontal,
+                                    ResampleFunction *ResampleVertical) {
+  *ResampleHorizontal = ImagingResampleHorizontal_8bpc;
+  *ResampleVertical = ImagingResampleVertical_8bpc;
+#ifdef RESAMPLE_SIMD
+  // 4 bands only, scalar stays the reference
+  if (bands == 4) {
+    switch (ImagingResampleGetSIMD()) {
+    case RESAMPLE_SIMD_AVX2:
+      *ResampleHorizontal = ImagingResampleHorizontal_8bpc_avx2;
+      *ResampleVertical = ImagingResampleVertical_8bpc_avx2;
+      break;
+    case RESAMPLE_SIMD_SSE4:
+      *ResampleHorizontal = ImagingResampleHorizontal_8bpc_sse4;
+      *ResampleVertical = ImagingResampleVertical_8bpc_sse4;
+      break;
+    }
+  }
+#else
+  (void)bands;
+#endif
+}
+
 Imaging ImagingResample(Imaging imIn, int xsize, int ysize, int filter,
                         float box[4]) {
   struct filter *filterp;
@@ -649,8 +335,8 @@ Imaging ImagingResample(Imaging imIn, int xsize, int ysize, int filter,
   } else {
     switch (imIn->type) {
     case IMAGING_TYPE_UINT8:
-      ResampleHorizontal = ImagingResampleHorizontal_8bpc;
-      ResampleVertical = ImagingResampleVertical_8bpc;
+      resample_functions_8bpc(imIn->bands, &ResampleHorizontal,
+                              &ResampleVertical);
       break;
     case IMAGING_TYPE_INT32:
     case IMAGING_TYPE_FLOAT32:
@@ -663,26 +349,45 @@ Imaging ImagingResample(Imaging imIn, int xsize, int ysize, int filter,
   }
 
   /* check filter */
-  switch (filter) {
-  case IMAGING_TRANSFORM_BOX:
-    filterp = &BOX;
-    break;
-  case IMAGING_TRANSFORM_BILINEAR:
-    filterp = &BILINEAR;
-    break;
-  case IMAGING_TRANSFORM_HAMMING:
-    filterp = &HAMMING;
-    break;
-  case IMAGING_TRANSFORM_BICUBIC:
-    filterp = &BICUBIC;
-    break;
-  case IMAGING_TRANSFORM_LANCZOS:
-    filterp = &LANCZOS;
-    break;
-  default:
+  filterp = resample_filter(filter);
+  if (!filterp) {
     return (Imaging)ImagingError_ValueError("unsupported resampling filter");
   }
 
+  /* Large downsample: reduce, then resample the rest ( see Pillow's
+     Image.resize, reducing_gap ). Lanczos support grows with the scale, so
+     this cuts taps per output pixel by about the factor. */
+  if (resample_reducing_gap > 0.0 && imIn->bands == 4 &&
+      imIn->type == IMAGING_TYPE_UINT8 && !imIn->image8) {
+    int xfactor = (box[2] - box[0]) / xsize / resample_reducing_gap;
+    int yfactor = (box[3] - box[1]) / ysize / resample_reducing_gap;
+    xfactor = xfactor > 1 ? xfactor : 1;
+    yfactor = yfactor > 1 ? yfactor : 1;
+    if (xfactor > 1 || yfactor > 1) {
+      /* Pixels under the filter support, see Pillow's _get_safe_box */
+      double support_x = (filterp->support - 0.5) * (box[2] - box[0]) / xsize;
+      double support_y = (filterp->support - 0.5) * (box[3] - box[1]) / ysize;
+      int x0 = box[0] - support_x > 0 ? (int)(box[0] - support_x) : 0;
+      int y0 = box[1] - support_y > 0 ? (int)(box[1] - support_y) : 0;
+      int x1 = ceil(box[2] + support_x), y1 = ceil(box[3] + support_y);
+      x1 = x1 < imIn->xsize ? x1 : imIn->xsize;
+      y1 = y1 < imIn->ysize ? y1 : imIn->ysize;
+      int reduce_box[4] = {x0, y0, x1 - x0, y1 - y0};
+
+      Imaging imReduced = ImagingReduce(imIn, xfactor, yfactor, reduce_box);
+      if (!imReduced) {
+        return NULL;
+      }
+      float reduced[4] = {(box[0] - x0) / xfactor, (box[1] - y0) / yfactor,
+                          (box[2] - x0) / xfactor, (box[3] - y0) / yfactor};
+      Imaging imOut =
+          ImagingResampleInner(imReduced, xsize, ysize, filterp, reduced,
+                               ResampleHorizontal, ResampleVertical);
+      ImagingDelete(imReduced);
+      return imOut;
+    }
+  }
+
   return ImagingResampleInner(imIn, xsize, ysize, filterp, box,
                               ResampleHorizontal, ResampleVertical);
 }
@@ -694,79 +399,81 @@ Imaging ImagingResampleInner(Imaging imIn, int xsize, int ysize,
   Imaging imTemp = NULL;
   Imaging imOut = NULL;
 
-  int i, need_horizontal, need_vertical;
+  int need_horizontal, need_vertical;
   int ybox_first, ybox_last;
-  int ksize_horiz, ksize_vert;
-  int *bounds_horiz, *bounds_vert;
-  double *kk_horiz, *kk_vert;
+  // 8bpc passes take INT32 coefficients
+  int normalized = imIn->type == IMAGING_TYPE_UINT8;
+  ImagingResampleCoeffs horiz, vert;
 
   need_horizontal = xsize != imIn->xsize || box[0] || box[2] != xsize;
+  // BGRa is only swizzled to RGBa by the horizontal pass
+  need_horizontal = need_horizontal || strcmp(imIn->mode, "BGRa") == 0;
   need_vertical = ysize != imIn->ysize || box[1] || box[3] != ysize;
 
-  ksize_horiz = precompute_coeffs(imIn->xsize, box[0], box[2], xsize, filterp,
-                                  &bounds_horiz, &kk_horiz);
-  if (!ksize_horiz) {
+  // Shared and read only, see resample_coeffs.h
+  TRACE_BEGIN(coeffs);
+  horiz = ImagingResampleCoeffsGet(imIn->xsize, box[0], box[2], xsize, filterp,
+                                   normalized);
+  if (!horiz) {
     return NULL;
   }
 
-  ksize_vert = precompute_coeffs(imIn->ysize, box[1], box[3], ysize, filterp,
-                                 &bounds_vert, &kk_vert);
-  if (!ksize_vert) {
-    free(bounds_horiz);
-    free(kk_horiz);
+  vert = ImagingResampleCoeffsGet(imIn->ysize, box[1], box[3], ysize, filterp,
+                                  normalized);
+  if (!vert) {
+    ImagingResampleCoeffsRelease(horiz);
     return NULL;
   }
+  TRACE_END(coeffs, TRACE_COEFFS);
 
   // First used row in the source image
-  ybox_first = bounds_vert[0];
+  ybox_first = vert->bounds[0];
   // Last used row in the source image
-  ybox_last = bounds_vert[ysize * 2 - 2] + bounds_vert[ysize * 2 - 1];
+  ybox_last = vert->bounds[ysize * 2 - 2] + vert->bounds[ysize * 2 - 1];
 
   /* two-pass resize, horizontal pass */
   if (need_horizontal) {
-    // Shift bounds for vertical pass
-    for (i = 0; i < ysize; i++) {
-      bounds_vert[i * 2] -= ybox_first;
-    }
-
-    imTemp = ImagingNewDirty(imIn->mode, xsize, ybox_last - ybox_first);
+    imTemp = ImagingNewDirty(strcmp(imIn->mode, "BGRa") ? imIn->mode : "RGBa",
+                             xsize, ybox_last - ybox_first);
     if (imTemp) {
-      ResampleHorizontal(imTemp, imIn, ybox_first, ksize_horiz, bounds_horiz,
-                         kk_horiz);
+      TRACE_BEGIN(horizontal);
+      resample_pass(ResampleHorizontal, 0, imTemp, imIn, ybox_first,
+                    horiz->ksize, horiz->bounds, horiz->kk, normalized);
+      TRACE_END(horizontal, TRACE_HORIZONTAL);
     }
-    free(bounds_horiz);
-    free(kk_horiz);
+    ImagingResampleCoeffsRelease(horiz);
     if (!imTemp) {
-      free(bounds_vert);
-      free(kk_vert);
+      ImagingResampleCoeffsRelease(vert);
       return NULL;
     }
     imOut = imIn = imTemp;
   } else {
-    // Free in any case
-    free(bounds_horiz);
-    free(kk_horiz);
+    // Release in any case
+    ImagingResampleCoeffsRelease(horiz);
   }
 
   /* vertical pass */
   if (need_vertical) {
     imOut = ImagingNewDirty(imIn->mode, imIn->xsize, ysize);
     if (imOut) {
-      /* imIn can be the original image or horizontally resampled one */
-      ResampleVertical(imOut, imIn, 0, ksize_vert, bounds_vert, kk_vert);
+      /* imIn can be the original image or horizontally resampled one,
+         starting at the first used row */
+      TRACE_BEGIN(vertical);
+      resample_pass(ResampleVertical, 1, imOut, imIn, 0, vert->ksize,
+                    imTemp ? vert->bounds_shifted : vert->bounds, vert->kk,
+                    normalized);
+      TRACE_END(vertical, TRACE_VERTICAL);
     }
     /* it's safe to call ImagingDelete with empty value
        if previous step was not performed. */
     ImagingDelete(imTemp);
-    free(bounds_vert);
-    free(kk_vert);
+    ImagingResampleCoeffsRelease(vert);
     if (!imOut) {
       return NULL;
     }
   } else {
-    // Free in any case
-    free(bounds_vert);
-    free(kk_vert);
+    // Release in any case
+    ImagingResampleCoeffsRelease(vert);
   }
 
   /* none of the previous steps are performed, copying */
@@ -776,3 +483,5 @@ Imaging ImagingResampleInner(Imaging imIn, int xsize, int ysize,
 
   return imOut;
 }
+
+#include "resample_stream.h"
@@ -0,0 +1,173 @@
+// Cache of resample bounds and coefficients, shared by all tiles and threads.
+//
+// Tiles of one tiling share the scale, and their boxes repeat per column
+// ( horizontal pass ) and per row ( vertical pass ), so most passes find
+// their coefficients already evaluated and normalized: no filter calls, no
+// malloc. Keys are exact ( the float box as passed to ImagingResample ), so
+// results are the same as without the cache.
+// NOTE: Included from resample.h only, needs precompute_coeffs
+
+/* Direct mapped, a new key replaces the entry in its slot */
+#define RESAMPLE_COEFFS_SLOTS 256
+
+typedef struct ImagingResampleCoeffsInstance {
+  /* Key */
+  int inSize;
+  float in0, in1;
+  int outSize;
+  struct filter *filterp;
+  int normalized; /* INT32 PRECISION_BITS coefficients, for 8bpc passes */
+
+  /* Value */
+  int ksize;
+  int *bounds;
+  int *bounds_shifted; /* Same, less the first used row, for imTemp */
+  double *kk;          /* In place INT32 when normalized */
+
+  int refs; /* Users, plus one while in the cache */
+} *ImagingResampleCoeffs;
+
+static pthread_mutex_t resample_coeffs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ImagingResampleCoeffs resample_coeffs_slots[RESAMPLE_COEFFS_SLOTS];
+static int resample_coeffs_enabled = 1;
+static int64_t resample_coeffs_hits = 0;
+static int64_t resample_coeffs_misses = 0;
+
+static unsigned int resample_coeffs_slot(int inSize, float in0, float in1,
+                                         int outSize, struct filter *filterp,
+                                         int normalized) {
+  UINT32 b0, b1;
+  memcpy(&b0, &in0, sizeof(b0));
+  memcpy(&b1, &in1, sizeof(b1));
+  uint64_t h = (uint64_t)inSize * 0x9E3779B97F4A7C15ull;
+  h ^= ((uint64_t)b0 << 32 | b1) * 0xC2B2AE3D27D4EB4Full;
+  h ^= (uint64_t)outSize * 0x165667B19E3779F9ull + normalized;
+  h ^= (uint64_t)(uintptr_t)filterp;
+  h ^= h >> 29;
+  return h % RESAMPLE_COEFFS_SLOTS;
+}
+
+/* NOTE: Call with the mutex held */
+static void resample_coeffs_unref(ImagingResampleCoeffs coeffs) {
+  coeffs->refs -= 1;
+  if (coeffs->refs == 0) {
+    free(coeffs->bounds);
+    free(coeffs->bounds_shifted);
+    free(coeffs->kk);
+    free(coeffs);
+  }
+}
+
+static ImagingResampleCoeffs resample_coeffs_new(int inSize, float in0,
+                                                 float in1, int outSize,
+                                                 struct filter *filterp,
+                                                 int normalized) {
+  ImagingResampleCoeffs coeffs =
+      calloc(1, sizeof(struct ImagingResampleCoeffsInstance));
+  if (!coeffs) {
+    return (ImagingResampleCoeffs)ImagingError_MemoryError();
+  }
+  coeffs->ksize = precompute_coeffs(inSize, in0, in1, outSize, filterp,
+                                    &coeffs->bounds, &coeffs->kk);
+  if (!coeffs->ksize) {
+    free(coeffs);
+    return NULL;
+  }
+  coeffs->bounds_shifted = malloc(outSize * 2 * sizeof(int));
+  if (!coeffs->bounds_shifted) {
+    free(coeffs->bounds);
+    free(coeffs->kk);
+    free(coeffs);
+    return (ImagingResampleCoeffs)ImagingError_MemoryError();
+  }
+  for (int i = 0; i < outSize; i++) {
+    coeffs->bounds_shifted[i * 2 + 0] =
+        coeffs->bounds[i * 2 + 0] - coeffs->bounds[0];
+    coeffs->bounds_shifted[i * 2 + 1] = coeffs->bounds[i * 2 + 1];
+  }
+  if (normalized) {
+    normalize_coeffs_8bpc(outSize, coeffs->ksize, coeffs->kk);
+  }
+
+  coeffs->inSize = inSize;
+  coeffs->in0 = in0;
+  coeffs->in1 = in1;
+  coeffs->outSize = outSize;
+  coeffs->filterp = filterp;
+  coeffs->normalized = normalized;
+  coeffs->refs = 1;
+  return coeffs;
+}
+
+/* Coefficients of one pass, from the cache or computed ( and cached ).
+   NOTE: Remember to ImagingResampleCoeffsRelease */
+ImagingResampleCoeffs ImagingResampleCoeffsGet(int inSize, float in0,
+                                               float in1, int outSize,
+                                               struct filter *filterp,
+                                               int normalized) {
+  unsigned int slot =
+      resample_coeffs_slot(inSize, in0, in1, outSize, filterp, normalized);
+  ImagingResampleCoeffs coeffs;
+
+  pthread_mutex_lock(&resample_coeffs_mutex);
+  coeffs = resample_coeffs_slots[slot];
+  if (coeffs && coeffs->inSize == inSize && coeffs->in0 == in0 &&
+      coeffs->in1 == in1 && coeffs->outSize == outSize &&
+      coeffs->filterp == filterp && coeffs->normalized == normalized) {
+    coeffs->refs += 1;
+    resample_coeffs_hits += 1;
+    pthread_mutex_unlock(&resample_coeffs_mutex);
+    return coeffs;
+  }
+  resample_coeffs_misses += 1;
+  pthread_mutex_unlock(&resample_coeffs_mutex);
+
+  // Evaluate the filter without the lock
+  coeffs = resample_coeffs_new(inSize, in0, in1, outSize, filterp, normalized);
+  if (!coeffs) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&resample_coeffs_mutex);
+  if (resample_coeffs_enabled) {
+    if (resample_coeffs_slots[slot]) {
+      resample_coeffs_unref(resample_coeffs_slots[slot]);
+    }
+    coeffs->refs += 1;
+    resample_coeffs_slots[slot] = coeffs;
+  }
+  pthread_mutex_unlock(&resample_coeffs_mutex);
+  return coeffs;
+}
+
+void ImagingResampleCoeffsRelease(ImagingResampleCoeffs coeffs) {
+  if (!coeffs) {
+    return;
+  }
+  pthread_mutex_lock(&resample_coeffs_mutex);
+  resample_coeffs_unref(coeffs);
+  pthread_mutex_unlock(&resample_coeffs_mutex);
+}
+
+/* Enable or disable ( and empty ) the cache. Returns the previous state. */
+int ImagingResampleCoeffsSetCache(int enabled) {
+  pthread_mutex_lock(&resample_coeffs_mutex);
+  int previous = resample_coeffs_enabled;
+  for (int slot = 0; slot < RESAMPLE_COEFFS_SLOTS; slot++) {
+    if (resample_coeffs_slots[slot]) {
+      resample_coeffs_unref(resample_coeffs_slots[slot]);
+      resample_coeffs_slots[slot] = NULL;
+    }
+  }
+  resample_coeffs_enabled = enabled;
+  pthread_mutex_unlock(&resample_coeffs_mutex);
+  return previous;
+}
+
+/* Passes that found their coefficients cached, and those that did not */
+void ImagingResampleCoeffsStats(int64_t *hits, int64_t *misses) {
+  pthread_mutex_lock(&resample_coeffs_mutex);
+  *hits = resample_coeffs_hits;
+  *misses = resample_coeffs_misses;
+  pthread_mutex_unlock(&resample_coeffs_mutex);
+}
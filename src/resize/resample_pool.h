@@ -0,0 +1,189 @@
+// Parallel resample passes, on a small persistent thread pool.
+//
+// A pass is split in bands of output rows: input row bands for the
+// horizontal pass ( each band its own rows of imIn, via offset ), output row
+// bands for the vertical one ( each band its slice of bounds and kk ). All
+// bands share the precomputed coefficients, read only. The calling thread
+// works on bands too, and waits for the rest. Results are the same as the
+// serial pass, bit for bit.
+// One pass at a time: a pass started while the pool is busy ( e.g. from
+// read_regions_parallel's workers ) runs serially on its own thread.
+// NOTE: Included from resample.h only, needs ResampleFunction
+
+/* Passes smaller than this ( output pixels ) are not worth the handoff */
+#define RESAMPLE_POOL_MIN_PIXELS (128 * 128)
+/* Bands per thread, so faster threads can take more */
+#define RESAMPLE_POOL_BANDS 4
+
+typedef struct resample_pool_job_t {
+  ResampleFunction ResampleFunction;
+  int vertical;
+  Imaging imOut, imIn;
+  int offset, ksize, normalized;
+  int *bounds;
+  double *kk;
+  int bands;
+  int next; /* Next band to claim, atomic */
+} resample_pool_job_t;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t work; /* New job, or quit */
+  pthread_cond_t idle; /* A worker left the job */
+  pthread_t *threads;
+  int count;
+  resample_pool_job_t *job; /* Current job, NULL when idle */
+  unsigned int generation;  /* Jobs started */
+  int active;               /* Workers on the current job */
+  int quit;
+} resample_pool = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                   .work = PTHREAD_COND_INITIALIZER,
+                   .idle = PTHREAD_COND_INITIALIZER};
+
+/* Run band of job: a slice of imOut's rows */
+static void resample_pool_band(resample_pool_job_t *job, int band) {
+  int rows = job->imOut->ysize;
+  int row0 = (int64_t)rows * band / job->bands;
+  int row1 = (int64_t)rows * (band + 1) / job->bands;
+  if (row0 == row1) {
+    return;
+  }
+
+  // Same image, rows row0 to row1 only
+  struct ImagingMemoryInstance imOut = *job->imOut;
+  imOut.ysize = row1 - row0;
+  imOut.image = job->imOut->image + row0;
+  imOut.image8 = job->imOut->image8 ? job->imOut->image8 + row0 : NULL;
+  imOut.image32 = job->imOut->image32 ? job->imOut->image32 + row0 : NULL;
+
+  if (job->vertical) {
+    // Coefficients of the band's rows, INT32 in place when normalized
+    double *kk = job->normalized
+                     ? (double *)((INT32 *)job->kk + row0 * job->ksize)
+                     : job->kk + row0 * job->ksize;
+    job->ResampleFunction(&imOut, job->imIn, job->offset, job->ksize,
+                          job->bounds + row0 * 2, kk);
+  } else {
+    job->ResampleFunction(&imOut, job->imIn, job->offset + row0, job->ksize,
+                          job->bounds, job->kk);
+  }
+}
+
+static void resample_pool_run(resample_pool_job_t *job) {
+  int band;
+  while ((band = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+         job->bands) {
+    resample_pool_band(job, band);
+  }
+}
+
+static void *resample_pool_worker(void *arg) {
+  unsigned int seen = 0;
+  (void)arg;
+  pthread_mutex_lock(&resample_pool.lock);
+  for (;;) {
+    while (!resample_pool.quit &&
+           (!resample_pool.job || resample_pool.generation == seen)) {
+      pthread_cond_wait(&resample_pool.work, &resample_pool.lock);
+    }
+    if (resample_pool.quit) {
+      break;
+    }
+    seen = resample_pool.generation;
+    resample_pool_job_t *job = resample_pool.job;
+    resample_pool.active++;
+    pthread_mutex_unlock(&resample_pool.lock);
+
+    resample_pool_run(job);
+
+    pthread_mutex_lock(&resample_pool.lock);
+    resample_pool.active--;
+    pthread_cond_broadcast(&resample_pool.idle);
+  }
+  pthread_mutex_unlock(&resample_pool.lock);
+  return NULL;
+}
+
+/* Stop and join the workers */
+static void resample_pool_stop(void) {
+  pthread_mutex_lock(&resample_pool.lock);
+  resample_pool.quit = 1;
+  pthread_cond_broadcast(&resample_pool.work);
+  pthread_mutex_unlock(&resample_pool.lock);
+  for (int t = 0; t < resample_pool.count; t++) {
+    pthread_join(resample_pool.threads[t], NULL);
+  }
+  free(resample_pool.threads);
+  resample_pool.threads = NULL;
+  resample_pool.count = 0;
+  resample_pool.quit = 0;
+}
+
+/* Threads working on each pass, the calling one included; <= 1 -> serial
+   ( default ). Returns the number in use, fewer if threads failed to start.
+   NOTE: Not thread safe, set before resampling from threads */
+int ImagingResampleSetThreads(int threads) {
+  resample_pool_stop();
+  if (threads <= 1) {
+    return 1;
+  }
+  resample_pool.threads = calloc(threads - 1, sizeof(pthread_t));
+  if (!resample_pool.threads) {
+    return 1;
+  }
+  while (resample_pool.count < threads - 1) {
+    if (pthread_create(&resample_pool.threads[resample_pool.count], NULL,
+                       resample_pool_worker, NULL)) {
+      break;
+    }
+    resample_pool.count++;
+  }
+  return resample_pool.count + 1;
+}
+
+/* One pass, as ResampleFunction( imOut, imIn, offset, ksize, bounds, kk ),
+   on the pool when it is worth it and free */
+static void resample_pass(ResampleFunction ResampleFunction, int vertical,
+                          Imaging imOut, Imaging imIn, int offset, int ksize,
+                          int *bounds, double *kk, int normalized) {
+  resample_pool_job_t job = {
+      .ResampleFunction = ResampleFunction,
+      .vertical = vertical,
+      .imOut = imOut,
+      .imIn = imIn,
+      .offset = offset,
+      .ksize = ksize,
+      .normalized = normalized,
+      .bounds = bounds,
+      .kk = kk,
+      .bands = (resample_pool.count + 1) * RESAMPLE_POOL_BANDS,
+  };
+
+  int parallel = resample_pool.count > 0 &&
+                 (int64_t)imOut->xsize * imOut->ysize >=
+                     RESAMPLE_POOL_MIN_PIXELS;
+  if (parallel) {
+    pthread_mutex_lock(&resample_pool.lock);
+    parallel = !resample_pool.job;
+    if (parallel) {
+      resample_pool.job = &job;
+      resample_pool.generation++;
+      pthread_cond_broadcast(&resample_pool.work);
+    }
+    pthread_mutex_unlock(&resample_pool.lock);
+  }
+  if (!parallel) {
+    ResampleFunction(imOut, imIn, offset, ksize, bounds, kk);
+    return;
+  }
+
+  resample_pool_run(&job);
+
+  // Every band is claimed, wait for those still running elsewhere
+  pthread_mutex_lock(&resample_pool.lock);
+  while (resample_pool.active > 0) {
+    pthread_cond_wait(&resample_pool.idle, &resample_pool.lock);
+  }
+  resample_pool.job = NULL;
+  pthread_mutex_unlock(&resample_pool.lock);
+}
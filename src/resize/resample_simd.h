@@ -0,0 +1,285 @@
+// SIMD kernels for the 4-band 8bpc resample passes, chosen at runtime.
+//
+// Same fixed point math as the scalar kernels in resample.h: products of
+// pixel and PRECISION_BITS coefficient are summed in 32-bit lanes, so
+// results are bit-exact with the scalar path ( the reference ).
+// BGRa input ( openslide ARGB, little endian ) is swizzled to RGBa when
+// the horizontal pass stores its result.
+// NOTE: Included from resample.h only, needs PRECISION_BITS
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RESAMPLE_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* SIMD levels */
+#define RESAMPLE_SIMD_NONE 0
+#define RESAMPLE_SIMD_SSE4 1
+#define RESAMPLE_SIMD_AVX2 2
+
+/* Level in use */
+static int resample_simd_level;
+
+static int resample_simd_detect(void) {
+#ifdef RESAMPLE_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return RESAMPLE_SIMD_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return RESAMPLE_SIMD_SSE4;
+  }
+#endif
+  return RESAMPLE_SIMD_NONE;
+}
+
+/* Detected once at load, before any resampling thread exists */
+__attribute__((constructor)) static void resample_simd_init(void) {
+  resample_simd_level = resample_simd_detect();
+}
+
+/* Level used by ImagingResample */
+int ImagingResampleGetSIMD(void) { return resample_simd_level; }
+
+/* Cap the level ( e.g. RESAMPLE_SIMD_NONE for the scalar reference ).
+   Returns the level actually in use, never above what the cpu supports.
+   NOTE: Not thread safe, set before resampling from threads */
+int ImagingResampleSetSIMD(int level) {
+  int supported = resample_simd_detect();
+  resample_simd_level = level < supported ? level : supported;
+  if (resample_simd_level < 0) {
+    resample_simd_level = RESAMPLE_SIMD_NONE;
+  }
+  return resample_simd_level;
+}
+
+#ifdef RESAMPLE_SIMD
+
+/* Byte order of stored pixels */
+#define RESAMPLE_ORDER_RGBA                                                    \
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+#define RESAMPLE_ORDER_BGRA                                                    \
+  2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+
+// --- SSE4.1 ---
+
+__attribute__((target("sse4.1"))) static inline __m128i
+mm_load_pixel(const UINT8 *ptr) {
+  INT32 v;
+  memcpy(&v, ptr, sizeof(v));
+  return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+}
+
+__attribute__((target("sse4.1"))) static inline void
+mm_store_pixel(UINT8 *ptr, __m128i sss, __m128i order) {
+  INT32 v;
+  // Same as clip8, values are well within int16 after the shift
+  sss = _mm_srai_epi32(sss, PRECISION_BITS);
+  sss = _mm_packs_epi32(sss, sss);
+  sss = _mm_packus_epi16(sss, sss);
+  sss = _mm_shuffle_epi8(sss, order);
+  v = _mm_cvtsi128_si32(sss);
+  memcpy(ptr, &v, sizeof(v));
+}
+
+__attribute__((target("sse4.1"))) static void
+ImagingResampleHorizontal_8bpc_sse4(Imaging imOut, Imaging imIn, int offset,
+                                    int ksize, int *bounds, double *prekk) {
+  int xx, yy, x, xmin, xmax;
+  INT32 *k, *kk;
+  const __m128i initial = _mm_set1_epi32(1 << (PRECISION_BITS - 1));
+  const __m128i order = strcmp(imIn->mode, "BGRa") == 0
+                            ? _mm_setr_epi8(RESAMPLE_ORDER_BGRA)
+                            : _mm_setr_epi8(RESAMPLE_ORDER_RGBA);
+
+  // coefficients are normalized by ImagingResampleInner
+  kk = (INT32 *)prekk;
+
+  for (yy = 0; yy < imOut->ysize; yy++) {
+    UINT8 *lineIn = (UINT8 *)imIn->image[yy + offset];
+    UINT8 *lineOut = (UINT8 *)imOut->image[yy];
+    for (xx = 0; xx < imOut->xsize; xx++) {
+      __m128i sss = initial;
+      xmin = bounds[xx * 2 + 0];
+      xmax = bounds[xx * 2 + 1];
+      k = &kk[xx * ksize];
+      for (x = 0; x < xmax; x++) {
+        __m128i pix = mm_load_pixel(&lineIn[(x + xmin) * 4]);
+        sss = _mm_add_epi32(sss, _mm_mullo_epi32(pix, _mm_set1_epi32(k[x])));
+      }
+      mm_store_pixel(&lineOut[xx * 4], sss, order);
+    }
+  }
+}
+
+__attribute__((target("sse4.1"))) static void
+ImagingResampleVertical_8bpc_sse4(Imaging imOut, Imaging imIn, int offset,
+                                  int ksize, int *bounds, double *prekk) {
+  int xx, yy, y, ymin, ymax;
+  INT32 *k, *kk;
+  const __m128i initial = _mm_set1_epi32(1 << (PRECISION_BITS - 1));
+  const __m128i order = _mm_setr_epi8(RESAMPLE_ORDER_RGBA);
+  (void)offset;
+
+  // coefficients are normalized by ImagingResampleInner
+  kk = (INT32 *)prekk;
+
+  for (yy = 0; yy < imOut->ysize; yy++) {
+    UINT8 *lineOut = (UINT8 *)imOut->image[yy];
+    k = &kk[yy * ksize];
+    ymin = bounds[yy * 2 + 0];
+    ymax = bounds[yy * 2 + 1];
+    // 4 pixels at a time
+    for (xx = 0; xx + 3 < imOut->xsize; xx += 4) {
+      __m128i sss0 = initial, sss1 = initial, sss2 = initial, sss3 = initial;
+      for (y = 0; y < ymax; y++) {
+        __m128i mmk = _mm_set1_epi32(k[y]);
+        __m128i pix = _mm_loadu_si128(
+            (__m128i *)&imIn->image[y + ymin][xx * 4]);
+        sss0 = _mm_add_epi32(sss0, _mm_mullo_epi32(_mm_cvtepu8_epi32(pix),
+                                                   mmk));
+        sss1 = _mm_add_epi32(
+            sss1, _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(pix, 4)),
+                                  mmk));
+        sss2 = _mm_add_epi32(
+            sss2, _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(pix, 8)),
+                                  mmk));
+        sss3 = _mm_add_epi32(
+            sss3, _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(pix, 12)),
+                                  mmk));
+      }
+      sss0 = _mm_packs_epi32(_mm_srai_epi32(sss0, PRECISION_BITS),
+                             _mm_srai_epi32(sss1, PRECISION_BITS));
+      sss2 = _mm_packs_epi32(_mm_srai_epi32(sss2, PRECISION_BITS),
+                             _mm_srai_epi32(sss3, PRECISION_BITS));
+      _mm_storeu_si128((__m128i *)&lineOut[xx * 4],
+                       _mm_packus_epi16(sss0, sss2));
+    }
+    // Remaining pixels, one at a time
+    for (; xx < imOut->xsize; xx++) {
+      __m128i sss = initial;
+      for (y = 0; y < ymax; y++) {
+        __m128i pix = mm_load_pixel((UINT8 *)&imIn->image[y + ymin][xx * 4]);
+        sss = _mm_add_epi32(sss, _mm_mullo_epi32(pix, _mm_set1_epi32(k[y])));
+      }
+      mm_store_pixel(&lineOut[xx * 4], sss, order);
+    }
+  }
+}
+
+// --- AVX2 ---
+
+__attribute__((target("avx2"))) static void
+ImagingResampleHorizontal_8bpc_avx2(Imaging imOut, Imaging imIn, int offset,
+                                    int ksize, int *bounds, double *prekk) {
+  int xx, yy, x, xmin, xmax;
+  INT32 *k, *kk;
+  const __m128i initial = _mm_set1_epi32(1 << (PRECISION_BITS - 1));
+  const __m128i order = strcmp(imIn->mode, "BGRa") == 0
+                            ? _mm_setr_epi8(RESAMPLE_ORDER_BGRA)
+                            : _mm_setr_epi8(RESAMPLE_ORDER_RGBA);
+  // Coefficient of each pixel, broadcast to its 4 bands
+  const __m256i lo = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+  const __m256i hi = _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3);
+
+  // coefficients are normalized by ImagingResampleInner
+  kk = (INT32 *)prekk;
+
+  for (yy = 0; yy < imOut->ysize; yy++) {
+    UINT8 *lineIn = (UINT8 *)imIn->image[yy + offset];
+    UINT8 *lineOut = (UINT8 *)imOut->image[yy];
+    for (xx = 0; xx < imOut->xsize; xx++) {
+      __m256i sss256 = _mm256_setzero_si256();
+      __m128i sss;
+      xmin = bounds[xx * 2 + 0];
+      xmax = bounds[xx * 2 + 1];
+      k = &kk[xx * ksize];
+      // 4 pixels at a time, 2 per vector
+      for (x = 0; x + 3 < xmax; x += 4) {
+        __m128i pix = _mm_loadu_si128((__m128i *)&lineIn[(x + xmin) * 4]);
+        __m256i mmk =
+            _mm256_castsi128_si256(_mm_loadu_si128((__m128i *)&k[x]));
+        sss256 = _mm256_add_epi32(
+            sss256, _mm256_mullo_epi32(_mm256_cvtepu8_epi32(pix),
+                                       _mm256_permutevar8x32_epi32(mmk, lo)));
+        sss256 = _mm256_add_epi32(
+            sss256,
+            _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(pix, 8)),
+                               _mm256_permutevar8x32_epi32(mmk, hi)));
+      }
+      sss = _mm_add_epi32(_mm256_castsi256_si128(sss256),
+                          _mm256_extracti128_si256(sss256, 1));
+      sss = _mm_add_epi32(sss, initial);
+      // Remaining pixels, one at a time
+      for (; x < xmax; x++) {
+        __m128i pix = mm_load_pixel(&lineIn[(x + xmin) * 4]);
+        sss = _mm_add_epi32(sss, _mm_mullo_epi32(pix, _mm_set1_epi32(k[x])));
+      }
+      mm_store_pixel(&lineOut[xx * 4], sss, order);
+    }
+  }
+}
+
+__attribute__((target("avx2"))) static void
+ImagingResampleVertical_8bpc_avx2(Imaging imOut, Imaging imIn, int offset,
+                                  int ksize, int *bounds, double *prekk) {
+  int xx, yy, y, ymin, ymax;
+  INT32 *k, *kk;
+  const __m128i initial = _mm_set1_epi32(1 << (PRECISION_BITS - 1));
+  const __m128i order = _mm_setr_epi8(RESAMPLE_ORDER_RGBA);
+  const __m256i initial256 = _mm256_set1_epi32(1 << (PRECISION_BITS - 1));
+  // packs/packus work per 128-bit lane, this puts pixels back in order
+  const __m256i lanes = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  (void)offset;
+
+  // coefficients are normalized by ImagingResampleInner
+  kk = (INT32 *)prekk;
+
+  for (yy = 0; yy < imOut->ysize; yy++) {
+    UINT8 *lineOut = (UINT8 *)imOut->image[yy];
+    k = &kk[yy * ksize];
+    ymin = bounds[yy * 2 + 0];
+    ymax = bounds[yy * 2 + 1];
+    // 8 pixels at a time, 2 per vector
+    for (xx = 0; xx + 7 < imOut->xsize; xx += 8) {
+      __m256i sss0 = initial256, sss1 = initial256;
+      __m256i sss2 = initial256, sss3 = initial256;
+      for (y = 0; y < ymax; y++) {
+        __m256i mmk = _mm256_set1_epi32(k[y]);
+        UINT8 *lineIn = (UINT8 *)&imIn->image[y + ymin][xx * 4];
+        __m128i pix0 = _mm_loadu_si128((__m128i *)&lineIn[0]);
+        __m128i pix1 = _mm_loadu_si128((__m128i *)&lineIn[16]);
+        sss0 = _mm256_add_epi32(
+            sss0, _mm256_mullo_epi32(_mm256_cvtepu8_epi32(pix0), mmk));
+        sss1 = _mm256_add_epi32(
+            sss1,
+            _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(pix0, 8)),
+                               mmk));
+        sss2 = _mm256_add_epi32(
+            sss2, _mm256_mullo_epi32(_mm256_cvtepu8_epi32(pix1), mmk));
+        sss3 = _mm256_add_epi32(
+            sss3,
+            _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(pix1, 8)),
+                               mmk));
+      }
+      sss0 = _mm256_packs_epi32(_mm256_srai_epi32(sss0, PRECISION_BITS),
+                                _mm256_srai_epi32(sss1, PRECISION_BITS));
+      sss2 = _mm256_packs_epi32(_mm256_srai_epi32(sss2, PRECISION_BITS),
+                                _mm256_srai_epi32(sss3, PRECISION_BITS));
+      sss0 = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(sss0, sss2),
+                                         lanes);
+      _mm256_storeu_si256((__m256i *)&lineOut[xx * 4], sss0);
+    }
+    // Remaining pixels, one at a time
+    for (; xx < imOut->xsize; xx++) {
+      __m128i sss = initial;
+      for (y = 0; y < ymax; y++) {
+        __m128i pix = mm_load_pixel((UINT8 *)&imIn->image[y + ymin][xx * 4]);
+        sss = _mm_add_epi32(sss, _mm_mullo_epi32(pix, _mm_set1_epi32(k[y])));
+      }
+      mm_store_pixel(&lineOut[xx * 4], sss, order);
+    }
+  }
+}
+
+#endif // RESAMPLE_SIMD
@@ -0,0 +1,176 @@
+// Row streaming two-pass resample.
+//
+// ImagingResampleInner keeps the whole horizontal pass ( xsize x used input
+// rows ) before running the vertical one. Here input rows are pushed one at
+// a time, in order: each is resampled horizontally into a ring of as many
+// rows as the vertical support needs, and each output row is resampled
+// vertically and emitted as soon as its last input row is in. Same passes
+// and coefficients as ImagingResample, so same output, bit for bit
+// ( without reducing_gap ).
+// 4-band 8bpc only: RGBA, RGBa, or BGRa ( emitted as RGBa ).
+// NOTE: Included from resample.h only
+
+/* Called with each output row, in order, xsize pixels. Non zero -> stop */
+typedef int (*ImagingResampleRowFunction)(void *arg, int y, UINT8 *line);
+
+typedef struct ImagingResampleStreamInstance {
+  int inXsize, inYsize;
+  int xsize, ysize;
+  ImagingResampleRowFunction emit;
+  void *arg;
+
+  ImagingResampleCoeffs horiz, vert;
+  ResampleFunction ResampleHorizontal;
+  ResampleFunction ResampleVertical;
+  int ybox_first, ybox_last; /* Used input rows */
+
+  /* Horizontally resampled rows, input row y in slot y % ring_size */
+  int ring_size;
+  Imaging ring;
+  /* Views: one input row, one output row, the ring rows of one output row */
+  Imaging rowIn, rowOut, window;
+  Imaging imOut; /* One row, the emitted line */
+
+  int next_in;  /* Next input row expected */
+  int next_out; /* Next output row to emit */
+} *ImagingResampleStream;
+
+void ImagingResampleStreamDelete(ImagingResampleStream stream) {
+  if (!stream) {
+    return;
+  }
+  if (stream->horiz) {
+    ImagingResampleCoeffsRelease(stream->horiz);
+  }
+  if (stream->vert) {
+    ImagingResampleCoeffsRelease(stream->vert);
+  }
+  ImagingDelete(stream->ring);
+  ImagingDelete(stream->rowIn);
+  ImagingDelete(stream->rowOut);
+  ImagingDelete(stream->window);
+  ImagingDelete(stream->imOut);
+  free(stream);
+}
+
+/* Stream of a mode image of inXsize x inYsize, resampled to xsize x ysize
+   from box, as ImagingResample. emit gets every output row.
+   NOTE: Remember to ImagingResampleStreamDelete */
+ImagingResampleStream ImagingResampleStreamNew(const char *mode, int inXsize,
+                                               int inYsize, int xsize,
+                                               int ysize, int filter,
+                                               float box[4],
+                                               ImagingResampleRowFunction emit,
+                                               void *arg) {
+  struct filter *filterp = resample_filter(filter);
+  if (!filterp) {
+    return (ImagingResampleStream)ImagingError_ValueError(
+        "unsupported resampling filter");
+  }
+  if (strcmp(mode, "RGBA") && strcmp(mode, "RGBa") && strcmp(mode, "BGRa")) {
+    return (ImagingResampleStream)ImagingError_ModeError();
+  }
+
+  ImagingResampleStream stream =
+      calloc(1, sizeof(struct ImagingResampleStreamInstance));
+  if (!stream) {
+    return (ImagingResampleStream)ImagingError_MemoryError();
+  }
+  stream->inXsize = inXsize;
+  stream->inYsize = inYsize;
+  stream->xsize = xsize;
+  stream->ysize = ysize;
+  stream->emit = emit;
+  stream->arg = arg;
+  resample_functions_8bpc(4, &stream->ResampleHorizontal,
+                          &stream->ResampleVertical);
+
+  stream->horiz =
+      ImagingResampleCoeffsGet(inXsize, box[0], box[2], xsize, filterp, 1);
+  stream->vert =
+      stream->horiz
+          ? ImagingResampleCoeffsGet(inYsize, box[1], box[3], ysize, filterp, 1)
+          : NULL;
+  if (!stream->vert) {
+    ImagingResampleStreamDelete(stream);
+    return NULL;
+  }
+
+  // Rows under any one output row
+  int *bounds = stream->vert->bounds;
+  stream->ybox_first = bounds[0];
+  stream->ybox_last = bounds[ysize * 2 - 2] + bounds[ysize * 2 - 1];
+  for (int yy = 0; yy < ysize; yy++) {
+    if (bounds[yy * 2 + 1] > stream->ring_size) {
+      stream->ring_size = bounds[yy * 2 + 1];
+    }
+  }
+
+  // Horizontal pass swizzles BGRa to RGBa
+  const char *tempMode = strcmp(mode, "BGRa") ? mode : "RGBa";
+  stream->ring = ImagingNewDirty(tempMode, xsize, stream->ring_size);
+  stream->rowIn = ImagingNewPrologue(mode, inXsize, 1);
+  stream->rowOut = ImagingNewPrologue(tempMode, xsize, 1);
+  stream->window = ImagingNewPrologue(tempMode, xsize, stream->ring_size);
+  stream->imOut = ImagingNewDirty(tempMode, xsize, 1);
+  if (!stream->ring || !stream->rowIn || !stream->rowOut || !stream->window ||
+      !stream->imOut) {
+    ImagingResampleStreamDelete(stream);
+    return (ImagingResampleStream)ImagingError_MemoryError();
+  }
+  return stream;
+}
+
+/* Vertical pass of output row yy, from the ring */
+static int resample_stream_emit(ImagingResampleStream stream, int yy) {
+  int ymin = stream->vert->bounds[yy * 2 + 0];
+  int bounds[2] = {0, stream->vert->bounds[yy * 2 + 1]};
+  for (int y = 0; y < bounds[1]; y++) {
+    stream->window->image[y] =
+        stream->ring->image[(ymin + y) % stream->ring_size];
+  }
+  // Coefficients of row yy, normalized in place as INT32
+  INT32 *kk = (INT32 *)stream->vert->kk + yy * stream->vert->ksize;
+  stream->ResampleVertical(stream->imOut, stream->window, 0,
+                           stream->vert->ksize, bounds, (double *)kk);
+  return stream->emit(stream->arg, yy, (UINT8 *)stream->imOut->image[0]);
+}
+
+/* Next input row, inXsize pixels. Returns the number of output rows emitted,
+   -1 if there are no more input rows, or emit stopped the stream. */
+int ImagingResampleStreamPush(ImagingResampleStream stream, UINT8 *line) {
+  int y = stream->next_in;
+  if (y >= stream->inYsize) {
+    return -1;
+  }
+  stream->next_in++;
+  if (y < stream->ybox_first || y >= stream->ybox_last) {
+    return 0;
+  }
+
+  // Horizontal pass into the ring, over the row read ring_size rows ago
+  stream->rowIn->image[0] = (char *)line;
+  stream->rowOut->image[0] = stream->ring->image[y % stream->ring_size];
+  stream->ResampleHorizontal(stream->rowOut, stream->rowIn, 0,
+                             stream->horiz->ksize, stream->horiz->bounds,
+                             stream->horiz->kk);
+
+  // Every output row whose support ends here
+  int emitted = 0;
+  int *bounds = stream->vert->bounds;
+  while (stream->next_out < stream->ysize &&
+         bounds[stream->next_out * 2] + bounds[stream->next_out * 2 + 1] <=
+             y + 1) {
+    if (resample_stream_emit(stream, stream->next_out)) {
+      return -1;
+    }
+    stream->next_out++;
+    emitted++;
+  }
+  return emitted;
+}
+
+/* All output rows emitted */
+int ImagingResampleStreamDone(ImagingResampleStream stream) {
+  return stream->next_out == stream->ysize;
+}
@@ -34,7 +34,10 @@
  * See the README file for information on usage and redistribution.
  */
 
-#include "utils.h"
+#include "except.h"
+#include "imaging.h"
+#include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* Array Storage Type */
@@ -53,9 +56,33 @@ struct ImagingMemoryArena ImagingDefaultArena = {
     0,
     0,
     0,
-    0 // Stats
+    0, // Stats
+    PTHREAD_MUTEX_INITIALIZER,
+    0, // blocks_grow_only
 };
 
+static __thread ImagingMemoryArena thread_arena = NULL;
+
+ImagingMemoryArena ImagingGetArena(void) {
+  return thread_arena ? thread_arena : &ImagingDefaultArena;
+}
+
+void ImagingSetArena(ImagingMemoryArena arena) { thread_arena = arena; }
+
+int ImagingMemoryArenaInit(ImagingMemoryArena arena, int blocks_max) {
+  memset(arena, 0, sizeof(struct ImagingMemoryArena));
+  arena->alignment = ImagingDefaultArena.alignment;
+  arena->block_size = ImagingDefaultArena.block_size;
+  arena->blocks_grow_only = 1;
+  pthread_mutex_init(&arena->mutex, NULL);
+  return ImagingMemorySetBlocksMax(arena, blocks_max);
+}
+
+void ImagingMemoryArenaRelease(ImagingMemoryArena arena) {
+  ImagingMemorySetBlocksMax(arena, 0);
+  pthread_mutex_destroy(&arena->mutex);
+}
+
 /* --------------------------------------------------------------------
  * Standard image object.
  */
@@ -170,6 +197,12 @@ Imaging ImagingNewPrologueSubtype(const char *mode, int xsize, int ysize,
     im->bands = im->pixelsize = 4;
     im->linesize = xsize * 4;
 
+  } else if (strcmp(mode, "BGRa") == 0) {
+    /* 32-bit reversed true colour with premultiplied alpha */
+    /* ( openslide ARGB on little endian ) */
+    im->bands = im->pixelsize = 4;
+    im->linesize = xsize * 4;
+
   } else if (strcmp(mode, "CMYK") == 0) {
     /* 32-bit colour separation */
     im->bands = im->pixelsize = 4;
@@ -224,7 +257,10 @@ Imaging ImagingNewPrologueSubtype(const char *mode, int xsize, int ysize,
     break;
   }
 
-  ImagingDefaultArena.stats_new_count += 1;
+  ImagingMemoryArena arena = ImagingGetArena();
+  pthread_mutex_lock(&arena->mutex);
+  arena->stats_new_count += 1;
+  pthread_mutex_unlock(&arena->mutex);
 
   return im;
 }
@@ -250,6 +286,7 @@ void ImagingDelete(Imaging im) {
   free(im);
 }
 
+// NOTE: Not locked, configure the arena before reading from threads
 int ImagingMemorySetBlocksMax(ImagingMemoryArena arena, int blocks_max) {
   void *p;
   /* Free already cached blocks */
@@ -292,9 +329,13 @@ ImagingMemoryBlock memory_get_block(ImagingMemoryArena arena,
     // Get block from cache
     arena->blocks_cached -= 1;
     block = arena->blocks_pool[arena->blocks_cached];
-    // Reallocate if needed
-    if (block.size != requested_size) {
+    // Reallocate if needed. Blocks of grow only arenas keep their size when
+    // smaller ones are requested, so a pool serving requests of varying
+    // size settles and stops reallocating.
+    if (arena->blocks_grow_only ? block.size < requested_size
+                                : block.size != requested_size) {
       block.ptr = realloc(block.ptr, requested_size);
+      block.size = requested_size;
     }
     if (!block.ptr) {
       // Can't allocate, free previous pointer (it is still valid)
@@ -316,15 +357,16 @@ ImagingMemoryBlock memory_get_block(ImagingMemoryArena arena,
       block.ptr = calloc(1, requested_size);
     }
     arena->stats_allocated_blocks += 1;
+    block.size = requested_size;
   }
-  block.size = requested_size;
   return block;
 }
 
 void memory_return_block(ImagingMemoryArena arena, ImagingMemoryBlock block) {
   if (arena->blocks_cached < arena->blocks_max) {
-    // Reduce block size
-    if (block.size > arena->block_size) {
+    // Reduce block size, unless grow only: the next request would realloc
+    // it back up
+    if (!arena->blocks_grow_only && block.size > arena->block_size) {
       block.size = arena->block_size;
       block.ptr = realloc(block.ptr, arena->block_size);
     }
@@ -336,21 +378,38 @@ void memory_return_block(ImagingMemoryArena arena, ImagingMemoryBlock block) {
   }
 }
 
+ImagingMemoryBlock ImagingMemoryGetBlock(ImagingMemoryArena arena,
+                                         int requested_size, int dirty) {
+  pthread_mutex_lock(&arena->mutex);
+  ImagingMemoryBlock block = memory_get_block(arena, requested_size, dirty);
+  pthread_mutex_unlock(&arena->mutex);
+  return block;
+}
+
+void ImagingMemoryReturnBlock(ImagingMemoryArena arena,
+                              ImagingMemoryBlock block) {
+  pthread_mutex_lock(&arena->mutex);
+  memory_return_block(arena, block);
+  pthread_mutex_unlock(&arena->mutex);
+}
+
 static void ImagingDestroyArray(Imaging im) {
   int y = 0;
 
   if (im->blocks) {
+    pthread_mutex_lock(&im->arena->mutex);
     while (im->blocks[y].ptr) {
-      memory_return_block(&ImagingDefaultArena, im->blocks[y]);
+      memory_return_block(im->arena, im->blocks[y]);
       y += 1;
     }
+    pthread_mutex_unlock(&im->arena->mutex);
     free(im->blocks);
   }
 }
 
 Imaging ImagingAllocateArray(Imaging im, int dirty, int block_size) {
   int y, line_in_block, current_block;
-  ImagingMemoryArena arena = &ImagingDefaultArena;
+  ImagingMemoryArena arena = ImagingGetArena();
   ImagingMemoryBlock block = {NULL, 0};
   int aligned_linesize, lines_per_block, blocks_count;
   char *aligned_ptr = NULL;
@@ -375,6 +434,7 @@ Imaging ImagingAllocateArray(Imaging im, int dirty, int block_size) {
   if (!im->blocks) {
     return (Imaging)ImagingError_MemoryError();
   }
+  im->arena = arena;
 
   /* Allocate image as an array of lines */
   line_in_block = 0;
@@ -387,7 +447,9 @@ Imaging ImagingAllocateArray(Imaging im, int dirty, int block_size) {
         lines_remaining = im->ysize - y;
       }
       required = lines_remaining * aligned_linesize + arena->alignment - 1;
+      pthread_mutex_lock(&arena->mutex);
       block = memory_get_block(arena, required, dirty);
+      pthread_mutex_unlock(&arena->mutex);
       if (!block.ptr) {
         ImagingDestroyArray(im);
         return (Imaging)ImagingError_MemoryError();
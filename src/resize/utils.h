@@ -5,7 +5,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef M_PI
 #define M_PI 3.1415926535897932384626433832795
+#endif
 #define ROUND_UP(f) ((int)((f) >= 0.0 ? (f) + 0.5F : (f)-0.5F))
 
 struct filter {
@@ -0,0 +1,212 @@
+#include "schedule.h"
+#include "cache.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Sort key of a request
+typedef struct schedule_key_t {
+  int level;
+  int64_t tile_y, tile_x;
+  int64_t index;
+} schedule_key_t;
+
+static int compare_keys(const void *a, const void *b) {
+  const schedule_key_t *ka = a, *kb = b;
+  if (ka->level != kb->level) {
+    return ka->level < kb->level ? -1 : 1;
+  }
+  if (ka->tile_y != kb->tile_y) {
+    return ka->tile_y < kb->tile_y ? -1 : 1;
+  }
+  if (ka->tile_x != kb->tile_x) {
+    return ka->tile_x < kb->tile_x ? -1 : 1;
+  }
+  return (ka->index > kb->index) - (ka->index < kb->index);
+}
+
+static int same_tile(const schedule_key_t *a, const schedule_key_t *b) {
+  return (a->level == b->level) & (a->tile_y == b->tile_y) &
+         (a->tile_x == b->tile_x);
+}
+
+// Tile size of a level as stored in the file, or the cache block size
+// ( also when planning without openslide, osr NULL )
+static ipos_t level_tile_size(openslide_t *osr, int level) {
+  ipos_t tile_size = {.x = TILE_CACHE_BLOCK_SIZE, .y = TILE_CACHE_BLOCK_SIZE};
+  if (!osr) {
+    return tile_size;
+  }
+  char name[64];
+  const char *value;
+  snprintf(name, sizeof(name), "openslide.level[%d].tile-width", level);
+  if ((value = openslide_get_property_value(osr, name)) && atol(value) > 0) {
+    tile_size.x = atol(value);
+  }
+  snprintf(name, sizeof(name), "openslide.level[%d].tile-height", level);
+  if ((value = openslide_get_property_value(osr, name)) && atol(value) > 0) {
+    tile_size.y = atol(value);
+  }
+  return tile_size;
+}
+
+// Sort requests by native tile, one group per tile
+static int group_by_tile(schedule_t *schedule, request_t *requests,
+                         openslide_t *osr, level_props_t level_props) {
+  int64_t n = schedule->n_requests;
+  schedule_key_t *keys = malloc(n * sizeof(schedule_key_t));
+  ipos_t *tile_sizes = malloc(level_props.level_count * sizeof(ipos_t));
+  if (!keys || !tile_sizes) {
+    free(keys);
+    free(tile_sizes);
+    return 1;
+  }
+  for (int level = 0; level < level_props.level_count; level++) {
+    tile_sizes[level] = level_tile_size(osr, level);
+  }
+
+  for (int64_t i = 0; i < n; i++) {
+    int level = requests[i].level;
+    double downsample = level_props.level_downsamples[level];
+    keys[i] = (schedule_key_t){
+        .level = level,
+        .tile_y = floor(requests[i].location.y / downsample /
+                        tile_sizes[level].y),
+        .tile_x = floor(requests[i].location.x / downsample /
+                        tile_sizes[level].x),
+        .index = i,
+    };
+  }
+  qsort(keys, n, sizeof(schedule_key_t), compare_keys);
+
+  for (int64_t i = 0; i < n; i++) {
+    schedule->order[i] = keys[i].index;
+    if ((i == 0) || !same_tile(&keys[i], &keys[i - 1])) {
+      schedule->groups[schedule->n_groups++].start = i;
+    }
+    schedule->groups[schedule->n_groups - 1].end = i + 1;
+  }
+
+  free(keys);
+  free(tile_sizes);
+  return 0;
+}
+
+schedule_t *schedule_new(request_t *requests, int64_t n_requests,
+                         int n_workers, schedule_policy_t policy,
+                         openslide_t *osr, level_props_t level_props) {
+  if (n_workers <= 0) {
+    n_workers = 1;
+  }
+  schedule_t *schedule = calloc(1, sizeof(schedule_t));
+  if (!schedule) {
+    return NULL;
+  }
+  schedule->policy = policy;
+  schedule->n_workers = n_workers;
+  schedule->n_requests = n_requests;
+  schedule->order = malloc(MAX(n_requests, 1) * sizeof(int64_t));
+  schedule->groups = malloc(MAX(n_requests, 1) * sizeof(schedule_group_t));
+  schedule->items = malloc(MAX(n_requests, 1) * sizeof(int64_t));
+  schedule->deques = calloc(n_workers, sizeof(schedule_deque_t));
+  if (!schedule->order || !schedule->groups || !schedule->items ||
+      !schedule->deques) {
+    free(schedule->order);
+    free(schedule->groups);
+    free(schedule->items);
+    free(schedule->deques);
+    free(schedule);
+    return NULL;
+  }
+  for (int w = 0; w < n_workers; w++) {
+    pthread_mutex_init(&schedule->deques[w].lock, NULL);
+  }
+
+  if (policy == SCHEDULE_ROUND_ROBIN) {
+    // One group per request, in order, dealt like cards
+    for (int64_t i = 0; i < n_requests; i++) {
+      schedule->order[i] = i;
+      schedule->groups[i] = (schedule_group_t){.start = i, .end = i + 1};
+    }
+    schedule->n_groups = n_requests;
+    int64_t item = 0;
+    for (int w = 0; w < n_workers; w++) {
+      schedule_deque_t *deque = &schedule->deques[w];
+      deque->items = &schedule->items[item];
+      for (int64_t g = w; g < n_requests; g += n_workers) {
+        deque->items[deque->tail++] = g;
+      }
+      item += deque->tail;
+    }
+    return schedule;
+  }
+
+  if (group_by_tile(schedule, requests, osr, level_props)) {
+    schedule_free(schedule);
+    return NULL;
+  }
+
+  // Contiguous runs of groups, cut when a worker has its share of requests
+  int64_t g = 0;
+  for (int w = 0; w < n_workers; w++) {
+    schedule_deque_t *deque = &schedule->deques[w];
+    deque->items = &schedule->items[g];
+    int64_t share = n_requests * (w + 1) / n_workers;
+    while ((g < schedule->n_groups) &&
+           ((w == n_workers - 1) || (schedule->groups[g].end <= share) ||
+            (deque->tail == 0))) {
+      deque->items[deque->tail++] = g++;
+    }
+  }
+  return schedule;
+}
+
+void schedule_free(schedule_t *schedule) {
+  if (!schedule) {
+    return;
+  }
+  for (int w = 0; w < schedule->n_workers; w++) {
+    pthread_mutex_destroy(&schedule->deques[w].lock);
+  }
+  free(schedule->order);
+  free(schedule->groups);
+  free(schedule->items);
+  free(schedule->deques);
+  free(schedule);
+}
+
+// Group from the head of own deque, or the tail of a victim's, or -1
+static int64_t pop_group(schedule_deque_t *deque, int steal) {
+  int64_t group = -1;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->head < deque->tail) {
+    group = steal ? deque->items[--deque->tail] : deque->items[deque->head++];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return group;
+}
+
+int64_t schedule_next(schedule_t *schedule, int worker) {
+  schedule_deque_t *deque = &schedule->deques[worker];
+  if (deque->next < deque->end) {
+    return schedule->order[deque->next++];
+  }
+
+  int64_t group = pop_group(deque, 0);
+  if ((group < 0) & (schedule->policy == SCHEDULE_LOCALITY)) {
+    // Idle, steal from the next workers in turn
+    for (int w = 1; (w < schedule->n_workers) & (group < 0); w++) {
+      int victim = (worker + w) % schedule->n_workers;
+      group = pop_group(&schedule->deques[victim], 1);
+    }
+    if (group >= 0) {
+      __atomic_fetch_add(&schedule->steals, 1, __ATOMIC_RELAXED);
+    }
+  }
+  if (group < 0) {
+    return -1;
+  }
+  deque->next = schedule->groups[group].start;
+  deque->end = schedule->groups[group].end;
+  return schedule->order[deque->next++];
+}
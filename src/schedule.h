@@ -0,0 +1,50 @@
+#pragma once
+
+#include "types.h"
+#include <openslide/openslide.h>
+#include <pthread.h>
+
+// How a batch of requests is dealt to workers
+typedef enum schedule_policy_t {
+  SCHEDULE_ROUND_ROBIN, // request i -> worker i % n_workers, no stealing
+  SCHEDULE_LOCALITY,    // groups by native tile, contiguous, with stealing
+} schedule_policy_t;
+
+// Requests order[start, end) start in the same native level tile
+typedef struct schedule_group_t {
+  int64_t start, end;
+} schedule_group_t;
+
+// Groups of one worker. The owner pops from the head, thieves from the tail,
+// the group furthest away from what the owner is reading.
+typedef struct schedule_deque_t {
+  pthread_mutex_t lock;
+  int64_t *items; // group indices
+  int64_t head, tail;
+  int64_t next, end; // current group, touched by the owner only
+} schedule_deque_t;
+
+typedef struct schedule_t {
+  schedule_policy_t policy;
+  int n_workers;
+  int64_t n_requests;
+  int64_t *order; // request indices, grouped
+  int64_t n_groups;
+  schedule_group_t *groups;
+  int64_t *items; // backing store of all deques
+  schedule_deque_t *deques;
+  int64_t steals;
+} schedule_t;
+
+// Group requests by (level, native tile row, native tile column), with tile
+// size from openslide.level[N].tile-width/height, and deal groups to workers
+// in row major runs of about n_requests / n_workers requests each.
+// NOTE: Remember to free
+schedule_t *schedule_new(request_t *requests, int64_t n_requests,
+                         int n_workers, schedule_policy_t policy,
+                         openslide_t *osr, level_props_t level_props);
+void schedule_free(schedule_t *schedule);
+
+// Next request index for a worker, -1 once all deques are empty.
+// Thread safe, each worker calls it with its own index.
+int64_t schedule_next(schedule_t *schedule, int worker);
@@ -1,9 +1,14 @@
 #include "slide.h"
 #include "constants.h"
 #include "resize.h"
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+static void oslide_free_arenas(oslide_t *oslide);
 
 oslide_t oslide_open(char *path) {
   openslide_t *osr = openslide_open(path);
@@ -22,10 +27,14 @@ oslide_t oslide_open(char *path) {
                              .spacings = osr_spacings(osr),
                              .offset = osr_offset(osr),
                              .bounds = osr_bounds(osr),
+                             .background = osr_background_color(osr),
+                         },
+                     .level_props =
+                         {
+                             .level_count = openslide_get_level_count(osr),
                          },
-                     .level_props = {
-                         .level_count = openslide_get_level_count(osr),
-                     }};
+                     .arena_blocks_max = OSLIDE_ARENA_BLOCKS_MAX,
+                     .trace = trace_new()};
 
   // Shortcut for size
   oslide.level_props.slide_size = oslide.slide_props.size;
@@ -42,9 +51,63 @@ oslide_t oslide_open(char *path) {
   oslide.level_props.level_dimensions = malloc(level_count * sizeof(ipos_t));
   osr_level_dimensions(osr, level_count, oslide.level_props.level_dimensions);
 
+  // To check cached descriptors against, see oslide_osr
+  const char *quickhash = osr_quickhash(osr);
+  snprintf(oslide.quickhash, OSLIDE_QUICKHASH_SIZE, "%s",
+           quickhash ? quickhash : "");
+
   return oslide;
 }
 
+oslide_t oslide_open_cached(char *path, const char *cache_dir) {
+  char cache_path[4096];
+  int cached = !slide_descriptor_cache_path(cache_path, sizeof(cache_path),
+                                            cache_dir, path);
+
+  // Hit: props only, openslide is opened by oslide_osr
+  slide_descriptor_t descriptor;
+  if (cached && !slide_descriptor_read(&descriptor, cache_path)) {
+    oslide_t oslide = {.path = path,
+                       .osr = NULL,
+                       .slide_props = descriptor.slide_props,
+                       .level_props = descriptor.level_props,
+                       .arena_blocks_max = OSLIDE_ARENA_BLOCKS_MAX,
+                       .trace = trace_new()};
+    memcpy(oslide.quickhash, descriptor.quickhash, OSLIDE_QUICKHASH_SIZE);
+    return oslide;
+  }
+
+  // Miss: open as usual, and leave a descriptor for next time
+  oslide_t oslide = oslide_open(path);
+  if (cached && oslide.osr && !openslide_get_error(oslide.osr)) {
+    mkdir(cache_dir, 0755);
+    memcpy(descriptor.quickhash, oslide.quickhash, OSLIDE_QUICKHASH_SIZE);
+    descriptor.slide_props = oslide.slide_props;
+    descriptor.level_props = oslide.level_props;
+    slide_descriptor_write(&descriptor, cache_path);
+  }
+  return oslide;
+}
+
+openslide_t *oslide_osr(oslide_t *oslide) {
+  if (oslide->osr) {
+    return oslide->osr;
+  }
+  openslide_t *osr = openslide_open(oslide->path);
+  if (!osr) {
+    return NULL;
+  }
+  // Descriptor was made from another file at the same path
+  const char *quickhash = osr_quickhash(osr);
+  if (openslide_get_error(osr) ||
+      strcmp(quickhash ? quickhash : "", oslide->quickhash)) {
+    openslide_close(osr);
+    return NULL;
+  }
+  oslide->osr = osr;
+  return osr;
+}
+
 void oslide_print(oslide_t *oslide) {
   printf("mpp     : %f\n", oslide->slide_props.mpp);
   printf("spacing : %f, %f\n", oslide->slide_props.spacings.x,
@@ -77,7 +140,15 @@ void oslide_close(oslide_t *oslide) {
   if (oslide->level_props.level_dimensions) {
     free(oslide->level_props.level_dimensions);
   }
-  openslide_close(oslide->osr);
+  // Cache and worker handles, if any
+  tile_cache_free(oslide->cache);
+  oslide_close_handles(oslide);
+  oslide_free_arenas(oslide);
+  trace_free(oslide->trace);
+  // Never opened, if only planned from a cached descriptor
+  if (oslide->osr) {
+    openslide_close(oslide->osr);
+  }
 }
 
 int osr_length_associated_images(openslide_t *osr) {
@@ -108,6 +179,7 @@ int osr_thumbnail(openslide_t *osr, image_t *thumbnail, AssociatedImage name) {
       thumbnail->width = w;
       thumbnail->height = h;
       thumbnail->bands = 4; // RGBA
+      thumbnail->format = IMAGE_RGBA;
       thumbnail->data = malloc(w * h * sizeof(uint32_t));
 
       // Read thumbnail - ARGB
@@ -237,6 +309,28 @@ ipos_t osr_bounds(openslide_t *osr) {
   return bounds;
 }
 
+double osr_scaling(openslide_t *osr, double mpp) {
+  // Set to zero if slide mpp is not found
+  if (mpp <= 0.0) {
+    return 0.0;
+  }
+  return osr_mpp(osr) / mpp;
+}
+
+const char *osr_quickhash(openslide_t *osr) {
+  return openslide_get_property_value(osr, PROPERTY_NAME_QUICKHASH1);
+}
+
+uint32_t osr_background_color(openslide_t *osr) {
+  const char *c_color =
+      openslide_get_property_value(osr, PROPERTY_NAME_BACKGROUND_COLOR);
+  // Set to white if not found
+  if (!c_color) {
+    return 0xffffff;
+  }
+  return strtoul(c_color, NULL, 16) & 0xffffff;
+}
+
 /* Return a region at a specific scaling level of the pyramid.
  *
  * A typical slide is made of several levels at different mpps.
@@ -295,34 +389,157 @@ int is_valid_region(ipos_t location, double scaling, ipos_t size,
   return 1;
 }
 
-request_t read_region_request(ipos_t location, double scaling, ipos_t size,
-                              openslide_t *osr, level_props_t level_props) {
-  // NOTE: Assuming ` is_valid_region(...) == 1 `
+int best_level_for_downsample(level_props_t level_props, double downsample) {
+  // Same as openslide_get_best_level_for_downsample
+  if (downsample < level_props.level_downsamples[0]) {
+    return 0;
+  }
+  for (int level = 1; level < level_props.level_count; level++) {
+    if (downsample < level_props.level_downsamples[level]) {
+      return level - 1;
+    }
+  }
+  return level_props.level_count - 1;
+}
 
+native_level_t native_level_request(double scaling, openslide_t *osr,
+                                    level_props_t level_props) {
   // For our example
   // LEVEL_SIZE:  [11477  8212]
   // BEST_LEVEL:  1
   // NATIVE_LEVEL_SIZE:  (11500, 8228)
   // NATIVE_LEVEL_DOWNSAMPLE:  4.000121536217793
 
-  // Convert location and size to double
-  // Get best level from openslide
-  int native_level = openslide_get_best_level_for_downsample(osr, 1 / scaling);
+  // Get best level from openslide, or the same from level_props
+  int level = osr ? openslide_get_best_level_for_downsample(osr, 1 / scaling)
+                  : best_level_for_downsample(level_props, 1 / scaling);
 
-  // Convert location and size to double
-  ipos_t native_level_size = level_props.level_dimensions[native_level];
-  double native_level_downsample = level_props.level_downsamples[native_level];
-  double native_scaling = scaling * native_level_downsample;
-  dpos_t native_location = _div(_double(location), native_scaling);
-  dpos_t native_size = _div(_double(size), native_scaling);
+  return native_level_at(level, scaling, level_props);
+}
+
+native_level_t native_level_at(int level, double scaling,
+                               level_props_t level_props) {
+  native_level_t native_level = {
+      .level = level,
+      .size = level_props.level_dimensions[level],
+      .downsample = level_props.level_downsamples[level],
+      .scaling = scaling * level_props.level_downsamples[level],
+  };
 
   // PIL lanczos uses 3 pixels as support. See pillow: https://git.io/JG0QD
-  double native_extra_pixels;
-  if (native_scaling > 1) {
-    native_extra_pixels = 3.0;
+  if (native_level.scaling > 1) {
+    native_level.extra_pixels = 3.0;
   } else {
-    native_extra_pixels = ceil(3 / native_scaling);
+    native_level.extra_pixels = ceil(3 / native_level.scaling);
+  }
+
+  return native_level;
+}
+
+// Estimated cost of one size tile read from level and resampled
+static void level_cost(level_choice_t *choice, int level, double scaling,
+                       ipos_t size, level_policy_t policy,
+                       level_props_t level_props) {
+  native_level_t native_level = native_level_at(level, scaling, level_props);
+  double s = native_level.scaling;
+
+  // Padded native region, at most the whole level
+  double native_x = MIN(size.x / s + 2 * native_level.extra_pixels,
+                        (double)native_level.size.x);
+  double native_y = MIN(size.y / s + 2 * native_level.extra_pixels,
+                        (double)native_level.size.y);
+
+  // Pillow's kernel size, horizontal pass on every native row, then vertical
+  double taps = 2 * ceil(3 * MAX(1 / s, 1.0)) + 1;
+  choice->level = level;
+  choice->native_pixels = native_x * native_y;
+  choice->resample_taps = size.x * native_y * taps + size.x * size.y * taps;
+  choice->cost = policy.read_cost * choice->native_pixels +
+                 policy.resample_cost * choice->resample_taps;
+}
+
+level_choice_t choose_level(double scaling, ipos_t size,
+                            const level_policy_t *policy, openslide_t *osr,
+                            level_props_t level_props) {
+  level_choice_t choice;
+  level_policy_t costs = policy ? *policy : LEVEL_POLICY_DEFAULT;
+  int default_level = native_level_request(scaling, osr, level_props).level;
+  level_cost(&choice, default_level, scaling, size, costs, level_props);
+  choice.reason = LEVEL_REASON_DEFAULT;
+  choice.default_level = default_level;
+  choice.default_cost = choice.cost;
+  if (!policy) {
+    return choice;
+  }
+
+  // Within the bound: downsample <= 1 / scaling * max_upsample, the same
+  // comparison as openslide's for max_upsample = 1
+  double max_downsample = 1 / scaling * policy->max_upsample;
+  int found = 0;
+  for (int level = 0; level < level_props.level_count; level++) {
+    if (level_props.level_downsamples[level] > max_downsample) {
+      continue;
+    }
+    level_choice_t candidate = choice;
+    level_cost(&candidate, level, scaling, size, *policy, level_props);
+    if (!found || (candidate.cost < choice.cost)) {
+      choice = candidate;
+      found = 1;
+    }
+  }
+
+  if (!found) {
+    level_cost(&choice, 0, scaling, size, *policy, level_props);
+    choice.reason = LEVEL_REASON_FINEST;
+  } else if (choice.level == default_level) {
+    choice.reason = LEVEL_REASON_CHEAPEST;
+  } else if (choice.level > default_level) {
+    choice.reason = LEVEL_REASON_UPSAMPLE;
+  } else {
+    // max_upsample < 1 left openslide's level out
+    choice.reason = LEVEL_REASON_BOUND;
+  }
+  return choice;
+}
+
+const char *level_reason_name(level_reason_t reason) {
+  switch (reason) {
+  case LEVEL_REASON_DEFAULT:
+    return "default";
+  case LEVEL_REASON_CHEAPEST:
+    return "cheapest";
+  case LEVEL_REASON_UPSAMPLE:
+    return "upsample";
+  case LEVEL_REASON_FINEST:
+    return "finest";
+  case LEVEL_REASON_BOUND:
+    return "bound";
+  }
+  return "unknown";
+}
+
+native_level_t tiling_native_level(tiling_t tiling, openslide_t *osr,
+                                   level_props_t level_props,
+                                   level_choice_t *choice) {
+  level_choice_t chosen = choose_level(tiling.scaling, tiling.tile_size,
+                                       tiling.policy, osr, level_props);
+  if (choice) {
+    *choice = chosen;
   }
+  return native_level_at(chosen.level, tiling.scaling, level_props);
+}
+
+request_t native_region_request(ipos_t location, ipos_t size,
+                                native_level_t native_level) {
+  // NOTE: Assuming ` is_valid_region(...) == 1 `
+
+  // Convert location and size to double
+  ipos_t native_level_size = native_level.size;
+  double native_level_downsample = native_level.downsample;
+  double native_scaling = native_level.scaling;
+  double native_extra_pixels = native_level.extra_pixels;
+  dpos_t native_location = _div(_double(location), native_scaling);
+  dpos_t native_size = _div(_double(size), native_scaling);
 
   // Compute the native location while counting the extra pixels.
   ipos_t native_location_adapted =
@@ -351,7 +568,7 @@ request_t read_region_request(ipos_t location, double scaling, ipos_t size,
   // For read_region
   request_t request = {
       .location = level_zero_location_adapted,
-      .level = native_level,
+      .level = native_level.level,
       .size = native_size_adapted,
       .native =
           {
@@ -364,22 +581,223 @@ request_t read_region_request(ipos_t location, double scaling, ipos_t size,
   return request;
 }
 
-int read_region(image_t *region, openslide_t *osr, request_t request) {
-  // Region is expected size, so should be lower than request.size
+request_t read_region_request(ipos_t location, double scaling, ipos_t size,
+                              openslide_t *osr, level_props_t level_props) {
+  // NOTE: Assuming ` is_valid_region(...) == 1 `
+  native_level_t native_level =
+      native_level_request(scaling, osr, level_props);
+  return native_region_request(location, size, native_level);
+}
 
-  image_t padded_region = {
-      .width = request.size.x,
-      .height = request.size.y,
-      .bands = 4,
-      .data = malloc(request.size.x * request.size.y * sizeof(uint32_t))};
+// 128 bit products of int64_t, gcc / clang
+__extension__ typedef __int128 int128_t;
 
-  // We extract the region via openslide with the required extra border
-  openslide_read_region(osr, padded_region.data, request.location.x,
-                        request.location.y, request.level, request.size.x,
-                        request.size.y);
+// Integer division rounding down / up, b > 0. No branches, so the compiler
+// can keep it in registers across a batch.
+static inline int128_t floor_div(int128_t a, int128_t b) {
+  return a / b - (a % b < 0);
+}
+
+static inline int128_t ceil_div(int128_t a, int128_t b) {
+  return a / b + (a % b > 0);
+}
+
+native_level_exact_t native_level_exact(int level, rational_t scaling,
+                                        level_props_t level_props) {
+  // openslide's downsample is the mean of both axes' ratios:
+  // (w0 / w + h0 / h) / 2 = (w0 * h + h0 * w) / (2 * w * h)
+  ipos_t size0 = level_props.slide_size;
+  ipos_t size = level_props.level_dimensions[level];
+  rational_t downsample =
+      rational(size0.x * size.y + size0.y * size.x, 2 * size.x * size.y);
+  native_level_exact_t native_level = {
+      .level = level,
+      .size = size,
+      .downsample = downsample,
+      .scaling = rational_mul(scaling, downsample),
+  };
+
+  // Same as native_level_request: 3, or ceil(3 / scaling) when downsampling
+  rational_t s = native_level.scaling;
+  native_level.extra_pixels = s.num > s.den ? 3 : ceil_div(3 * s.den, s.num);
+  return native_level;
+}
+
+native_level_exact_t native_level_request_exact(rational_t scaling,
+                                                openslide_t *osr,
+                                                level_props_t level_props) {
+  double downsample = (double)scaling.den / scaling.num;
+  int level = osr ? openslide_get_best_level_for_downsample(osr, downsample)
+                  : best_level_for_downsample(level_props, downsample);
+  return native_level_exact(level, scaling, level_props);
+}
+
+// One axis of native_region_request_exact. With s = native scaling and
+// d = downsample, as ratios:
+//   native location         = location / s
+//   native location adapted = clip(floor(location / s) - extra)
+//   level 0 location        = floor(native location adapted * d)
+//   right edge              = clip(ceil((location + size) / s) + extra)
+//   native size adapted     = ceil(right edge - level 0 location / d)
+//   fractional coordinates  = location / s - level 0 location / d
+static inline void native_axis_exact(int64_t location, int64_t size,
+                                     int64_t level_size, rational_t s,
+                                     rational_t d, int64_t extra,
+                                     int64_t *level0, int64_t *native_size,
+                                     double *fractional, double *native) {
+  int64_t left = floor_div((int128_t)location * s.den, s.num) - extra;
+  left = MIN(MAX(left, 0), level_size);
+  int64_t l0 = floor_div((int128_t)left * d.num, d.den);
+
+  int64_t right =
+      ceil_div((int128_t)(location + size) * s.den, s.num) + extra;
+  right = MIN(MAX(right, 0), level_size);
+
+  *level0 = l0;
+  *native_size =
+      ceil_div((int128_t)right * d.num - (int128_t)l0 * d.den, d.num);
+
+  // Doubles only at the end, one rounding each
+  int128_t den = (int128_t)s.num * d.num;
+  *fractional = (double)((int128_t)location * s.den * d.num -
+                         (int128_t)l0 * d.den * s.num) /
+                (double)den;
+  *native = (double)((int128_t)size * s.den) / (double)s.num;
+}
+
+request_t native_region_request_exact(ipos_t location, ipos_t size,
+                                      native_level_exact_t native_level) {
+  request_t request = {.level = native_level.level};
+  native_axis_exact(location.x, size.x, native_level.size.x,
+                    native_level.scaling, native_level.downsample,
+                    native_level.extra_pixels, &request.location.x,
+                    &request.size.x,
+                    &request.native.fractional_coordinates.x,
+                    &request.native.native_size.x);
+  native_axis_exact(location.y, size.y, native_level.size.y,
+                    native_level.scaling, native_level.downsample,
+                    native_level.extra_pixels, &request.location.y,
+                    &request.size.y,
+                    &request.native.fractional_coordinates.y,
+                    &request.native.native_size.y);
+  return request;
+}
+
+request_t read_region_request_exact(ipos_t location, rational_t scaling,
+                                    ipos_t size, openslide_t *osr,
+                                    level_props_t level_props) {
+  native_level_exact_t native_level =
+      native_level_request_exact(scaling, osr, level_props);
+  return native_region_request_exact(location, size, native_level);
+}
+
+// Number of tiles along one axis, only tiles fully inside roi ( skip mode )
+static int64_t tiling_count(int64_t roi_size, int64_t tile_size,
+                            int64_t stride) {
+  if ((tile_size <= 0) | (stride <= 0) | (roi_size < tile_size)) {
+    return 0;
+  }
+  return (roi_size - tile_size) / stride + 1;
+}
+
+ipos_t tiling_grid_size(tiling_t tiling, level_props_t level_props) {
+  ipos_t roi_size = tiling.roi_size;
+  if ((roi_size.x == 0) & (roi_size.y == 0)) {
+    roi_size = get_scaled_size(level_props.slide_size, tiling.scaling);
+  }
+  ipos_t grid_size = {
+      .x = tiling_count(roi_size.x, tiling.tile_size.x,
+                        tiling.tile_size.x - tiling.overlap.x),
+      .y = tiling_count(roi_size.y, tiling.tile_size.y,
+                        tiling.tile_size.y - tiling.overlap.y),
+  };
+  return grid_size;
+}
+
+void tiling_grid_init(tiling_grid_t *grid, tiling_t tiling,
+                      level_props_t level_props) {
+  grid->tiling = tiling;
+  grid->level_props = level_props;
+  grid->size = tiling_grid_size(tiling, level_props);
+  grid->stride = (ipos_t){.x = tiling.tile_size.x - tiling.overlap.x,
+                          .y = tiling.tile_size.y - tiling.overlap.y};
+  grid->next = (ipos_t){0, 0};
+}
+
+int tiling_grid_next(tiling_grid_t *grid, ipos_t *location) {
+  tiling_t *tiling = &grid->tiling;
+  while ((grid->size.x > 0) & (grid->next.y < grid->size.y)) {
+    *location = (ipos_t){
+        .x = tiling->roi_location.x + grid->next.x * grid->stride.x,
+        .y = tiling->roi_location.y + grid->next.y * grid->stride.y};
+    if (++grid->next.x == grid->size.x) {
+      grid->next.x = 0;
+      grid->next.y++;
+    }
+    if (is_valid_region(*location, tiling->scaling, tiling->tile_size,
+                        grid->level_props)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+request_t *read_region_requests(tiling_t tiling, openslide_t *osr,
+                                level_props_t level_props,
+                                int64_t *n_requests) {
+  *n_requests = 0;
+  tiling_grid_t grid;
+  tiling_grid_init(&grid, tiling, level_props);
+
+  // NOTE: Remember to free
+  request_t *requests =
+      malloc(MAX(grid.size.x * grid.size.y, 1) * sizeof(request_t));
+  if (!requests) {
+    return NULL;
+  }
+
+  // Level choice and extra pixels are the same for the whole grid
+  native_level_t native_level =
+      tiling_native_level(tiling, osr, level_props, NULL);
+
+  int64_t n = 0;
+  ipos_t location;
+  while (tiling_grid_next(&grid, &location)) {
+    requests[n++] =
+        native_region_request(location, tiling.tile_size, native_level);
+  }
+
+  *n_requests = n;
+  return requests;
+}
+
+int64_t read_region_records(tiling_t tiling, openslide_t *osr,
+                            level_props_t level_props,
+                            request_record_t *records) {
+  tiling_grid_t grid;
+  tiling_grid_init(&grid, tiling, level_props);
+  native_level_t native_level =
+      tiling_native_level(tiling, osr, level_props, NULL);
 
+  int64_t n = 0;
+  ipos_t location;
+  while (tiling_grid_next(&grid, &location)) {
+    records[n++] = (request_record_t){
+        .location = location,
+        .scaling = tiling.scaling,
+        .size = tiling.tile_size,
+        .request =
+            native_region_request(location, tiling.tile_size, native_level),
+    };
+  }
+  return n;
+}
+
+// Box of the requested region within the padded one
+static dbox_t padded_region_box(request_t request, image_t *padded_region) {
   // TODO: Read size of returned region
-  dpos_t region_size = _double(request.size);
+  dpos_t region_size = {.x = padded_region->width,
+                        .y = padded_region->height};
 
   // # Within this region, there are a bunch of extra pixels, we interpolate
   // to sample # the pixel in the right position to retain the right sample
@@ -398,20 +816,464 @@ int read_region(image_t *region, openslide_t *osr, request_t request) {
       .x2 = clipped_bottom_right.x,
       .y2 = clipped_bottom_right.y,
   };
-  ipos_t size = request.size;
-  printf("box: %f, %f, %f, %f\n", box.x1, box.y1, box.x2, box.y2);
-  printf("size: %7ld, %7ld\n", size.x, size.y);
+  return box;
+}
 
-  // Resize in place, to replace data of original image
-  // NOTE: Unfortunately, does not support box! Need PIL methods
-  image_resize(region, &padded_region, size, VIPS_KERNEL_LANCZOS3);
+static int resample_padded_region(image_t *region, image_t *padded_region,
+                                  request_t request) {
+#ifdef WORDS_BIGENDIAN
+  // Convert to RGBA, as PIL would see it
+  TRACE_BEGIN(convert);
+  argb2rgba(padded_region->data, padded_region->width * padded_region->height);
+  TRACE_END(convert, TRACE_CONVERT);
+#endif
 
-  // TODO: Finally, resize and return
+  dbox_t box = padded_region_box(request, padded_region);
+
+  // Finally, resize and return
   // return region.resize(size, resample=resampling, box=box)
+#ifdef WORDS_BIGENDIAN
+  return image_resample(region, padded_region, box, IMAGING_TRANSFORM_LANCZOS);
+#else
+  // ARGB -> RGBA is fused into the resample
+  return image_resample_argb(region, padded_region, box,
+                             IMAGING_TRANSFORM_LANCZOS);
+#endif
+}
+
+// Padded ARGB buffer from the calling thread's arena. Arena blocks are int
+// sized: larger ones are plain malloc, with size -1
+// NOTE: Remember to padded_region_return
+static ImagingMemoryBlock padded_region_block(image_t *padded_region,
+                                              ipos_t size) {
+  int64_t bytes = size.x * size.y * (int64_t)sizeof(uint32_t);
+  ImagingMemoryBlock block;
+  if (bytes > INT_MAX) {
+    block = (ImagingMemoryBlock){.ptr = malloc(bytes), .size = -1};
+  } else {
+    block = ImagingMemoryGetBlock(ImagingGetArena(), bytes, 1);
+  }
+  *padded_region = (image_t){.width = size.x,
+                             .height = size.y,
+                             .bands = 4,
+                             .data = (uint32_t *)block.ptr};
+  return block;
+}
+
+static void padded_region_return(ImagingMemoryBlock block) {
+  if (block.size < 0) {
+    free(block.ptr);
+    return;
+  }
+  ImagingMemoryReturnBlock(ImagingGetArena(), block);
+}
+
+int read_region(image_t *region, openslide_t *osr, request_t request) {
+  // Region is expected size, so should be lower than request.size
+  // NOTE: region->data is expected to be allocated
+
+  TRACE_BEGIN(span);
+  image_t padded_region;
+  ImagingMemoryBlock block = padded_region_block(&padded_region, request.size);
+  if (!block.ptr) {
+    return 1;
+  }
+
+  // We extract the region via openslide with the required extra border
+  TRACE_BEGIN(decode);
+  openslide_read_region(osr, padded_region.data, request.location.x,
+                        request.location.y, request.level, request.size.x,
+                        request.size.y);
+  TRACE_END(decode, TRACE_DECODE);
+
+  int err = resample_padded_region(region, &padded_region, request);
+
+  padded_region_return(block);
+  TRACE_END(span, TRACE_READ_REGION);
+  return err;
+}
+
+int read_region_streamed(image_t *region, openslide_t *osr, request_t request,
+                         int strip_rows) {
+#ifdef WORDS_BIGENDIAN
+  // Streaming resample takes ARGB as BGRa
+  (void)strip_rows;
+  return read_region(region, osr, request);
+#else
+  // Strips on the native pixel grid, as tile cache blocks, so only where
+  // that grid is on whole level 0 pixels
+  double downsample = openslide_get_level_downsample(osr, request.level);
+  if (!tile_cache_level_supported(downsample)) {
+    return read_region(region, osr, request);
+  }
+
+  TRACE_BEGIN(span);
+  // Start at the native pixel below, and shift the box by the difference
+  dpos_t native_location = _div(_double(request.location), downsample);
+  ipos_t origin = _int(_floor(native_location));
+  dpos_t shift = _subv(native_location, _double(origin));
+  request.size = _int(_ceil(_addv(shift, _double(request.size))));
+  request.native.fractional_coordinates =
+      _addv(request.native.fractional_coordinates, shift);
+
+  strip_rows = MAX(MIN(strip_rows, request.size.y), 1);
+  image_t strip;
+  ImagingMemoryBlock block =
+      padded_region_block(&strip, (ipos_t){request.size.x, strip_rows});
+  if (!block.ptr) {
+    return 1;
+  }
+  image_t padded_region = {.width = request.size.x, .height = request.size.y};
+  image_resample_stream_t *stream = image_resample_stream_new(
+      region, request.size, padded_region_box(request, &padded_region),
+      IMAGING_TRANSFORM_LANCZOS);
+
+  int err = !stream;
+  int64_t x = llround(origin.x * downsample);
+  for (int64_t row = 0; !err && row < request.size.y; row += strip_rows) {
+    int rows = MIN(strip_rows, request.size.y - row);
+    TRACE_BEGIN(decode);
+    openslide_read_region(osr, strip.data, x,
+                          llround((origin.y + row) * downsample),
+                          request.level, request.size.x, rows);
+    TRACE_END(decode, TRACE_DECODE);
+    err = image_resample_stream_push(stream, strip.data, rows);
+  }
+  err |= !err && image_resample_stream_rows(stream) != region->height;
+
+  image_resample_stream_free(stream);
+  padded_region_return(block);
+  TRACE_END(span, TRACE_READ_REGION);
+  return err;
+#endif
+}
+
+int is_background_request(request_t request, slide_props_t slide_props,
+                          level_props_t level_props) {
+  // Level 0 extent of the padded region openslide would read
+  double downsample = level_props.level_downsamples[request.level];
+  ipos_t start = request.location;
+  ipos_t end = _int(_ceil(_addv(_double(request.location),
+                                _mul(_double(request.size), downsample))));
+  ipos_t bounds_start = slide_props.offset;
+  ipos_t bounds_end = {.x = slide_props.offset.x + slide_props.bounds.x,
+                       .y = slide_props.offset.y + slide_props.bounds.y};
+  return (end.x <= bounds_start.x) | (end.y <= bounds_start.y) |
+         (start.x >= bounds_end.x) | (start.y >= bounds_end.y);
+}
+
+void fill_background(image_t *region, uint32_t color) {
+  uint8_t r = color >> 16, g = color >> 8, b = color;
+#ifdef WORDS_BIGENDIAN
+  uint32_t pixel =
+      (uint32_t)r << 24 | (uint32_t)g << 16 | (uint32_t)b << 8 | 0xff;
+#else
+  uint32_t pixel = 0xff000000 | (uint32_t)b << 16 | (uint32_t)g << 8 | r;
+#endif
+  int64_t pixels = (int64_t)region->width * region->height;
+  uint8_t *bytes = (uint8_t *)region->data;
+  switch (region->format) {
+  case IMAGE_RGB:
+    fill_rgb(bytes, pixels, r, g, b);
+    break;
+  case IMAGE_CHW:
+    memset(bytes, r, pixels);
+    memset(bytes + pixels, g, pixels);
+    memset(bytes + 2 * pixels, b, pixels);
+    break;
+  default:
+    fill_uint32(region->data, pixels, pixel);
+  }
+}
+
+// Read through osr, one of the slide's handles, with buffers and resampler
+// temporaries from the given arena
+static int oslide_read_region_with(oslide_t *oslide, openslide_t *osr,
+                                   image_t *region, request_t request,
+                                   ImagingMemoryArena arena) {
+  if (is_background_request(request, oslide->slide_props,
+                            oslide->level_props)) {
+    fill_background(region, oslide->slide_props.background);
+    return 0;
+  }
+
+  ImagingMemoryArena previous = ImagingGetArena();
+  ImagingSetArena(arena);
+  TRACE_BIND(oslide->trace, previous_trace);
+  // Other levels can't be assembled from blocks without changing pixels
+  double downsample = oslide->level_props.level_downsamples[request.level];
+  if (!oslide->cache || !tile_cache_level_supported(downsample)) {
+    int err = read_region(region, osr, request);
+    TRACE_UNBIND(previous_trace);
+    ImagingSetArena(previous);
+    return err;
+  }
+
+  // Cached blocks are on the native pixel grid, and so is request.location
+  // / downsample for requests from native_region_request. Start at the
+  // native pixel below anyway, and shift the box by the difference.
+  dpos_t native_location = _div(_double(request.location), downsample);
+  ipos_t origin = _int(_floor(native_location));
+  dpos_t shift = _subv(native_location, _double(origin));
+  request.size = _int(_ceil(_addv(shift, _double(request.size))));
+  request.native.fractional_coordinates =
+      _addv(request.native.fractional_coordinates, shift);
+
+  TRACE_BEGIN(span);
+  image_t padded_region;
+  ImagingMemoryBlock block = padded_region_block(&padded_region, request.size);
+  int err = 1;
+  if (block.ptr) {
+    TRACE_BEGIN(decode);
+    tile_cache_read_region(oslide->cache, osr, padded_region.data, origin,
+                           request.level, downsample, request.size);
+    TRACE_END(decode, TRACE_DECODE);
+    err = resample_padded_region(region, &padded_region, request);
+    padded_region_return(block);
+  }
+  TRACE_END(span, TRACE_READ_REGION);
+  TRACE_UNBIND(previous_trace);
+  ImagingSetArena(previous);
+  return err;
+}
+
+// Make sure the slide has at least count arenas, see oslide_set_arenas
+// NOTE: Not thread safe, call before starting workers
+static int oslide_reserve_arenas(oslide_t *oslide, int count) {
+  if (count <= oslide->arena_count) {
+    return 0;
+  }
+  ImagingMemoryArena *arenas =
+      realloc(oslide->arenas, count * sizeof(ImagingMemoryArena));
+  if (!arenas) {
+    return 1;
+  }
+  oslide->arenas = arenas;
+  while (oslide->arena_count < count) {
+    ImagingMemoryArena arena = malloc(sizeof(struct ImagingMemoryArena));
+    if (!arena) {
+      return 1;
+    }
+    ImagingMemoryArenaInit(arena, oslide->arena_blocks_max);
+    oslide->arenas[oslide->arena_count++] = arena;
+  }
+  return 0;
+}
+
+int oslide_read_region(oslide_t *oslide, image_t *region, request_t request) {
+  if (oslide_reserve_arenas(oslide, 1)) {
+    return 1;
+  }
+  openslide_t *osr = oslide_osr(oslide);
+  if (!osr) {
+    return 1;
+  }
+  return oslide_read_region_with(oslide, osr, region, request,
+                                 oslide->arenas[0]);
+}
+
+int oslide_set_arenas(oslide_t *oslide, int blocks_max) {
+  oslide->arena_blocks_max = blocks_max;
+  int err = 0;
+  for (int i = 0; i < oslide->arena_count; i++) {
+    err |= !ImagingMemorySetBlocksMax(oslide->arenas[i], blocks_max);
+  }
+  return err;
+}
+
+arena_stats_t oslide_arena_stats(oslide_t *oslide) {
+  arena_stats_t stats = {0};
+  for (int i = 0; i < oslide->arena_count; i++) {
+    ImagingMemoryArena arena = oslide->arenas[i];
+    pthread_mutex_lock(&arena->mutex);
+    stats.new_count += arena->stats_new_count;
+    stats.allocated_blocks += arena->stats_allocated_blocks;
+    stats.reused_blocks += arena->stats_reused_blocks;
+    stats.reallocated_blocks += arena->stats_reallocated_blocks;
+    stats.freed_blocks += arena->stats_freed_blocks;
+    stats.blocks_cached += arena->blocks_cached;
+    pthread_mutex_unlock(&arena->mutex);
+  }
+  return stats;
+}
+
+trace_stats_t oslide_trace_stats(oslide_t *oslide) {
+  return trace_stats(oslide->trace);
+}
+
+void oslide_trace_dump(oslide_t *oslide, FILE *fp) {
+  trace_stats_t stats = trace_stats(oslide->trace);
+  trace_dump(&stats, fp);
+}
+
+void oslide_trace_reset(oslide_t *oslide) { trace_reset(oslide->trace); }
+
+static void oslide_free_arenas(oslide_t *oslide) {
+  for (int i = 0; i < oslide->arena_count; i++) {
+    ImagingMemoryArenaRelease(oslide->arenas[i]);
+    free(oslide->arenas[i]);
+  }
+  free(oslide->arenas);
+  oslide->arenas = NULL;
+  oslide->arena_count = 0;
+}
 
+int oslide_open_handles(oslide_t *oslide, int count) {
+  oslide_close_handles(oslide);
+  if (count <= 0) {
+    return 0;
+  }
+  // Also checks a cached descriptor still matches the file
+  if (!oslide_osr(oslide)) {
+    return 1;
+  }
+  oslide->handles = calloc(count, sizeof(openslide_t *));
+  if (!oslide->handles) {
+    return 1;
+  }
+  for (int i = 0; i < count; i++) {
+    oslide->handles[i] = openslide_open(oslide->path);
+    if (!oslide->handles[i] || openslide_get_error(oslide->handles[i])) {
+      oslide->handle_count = i + 1;
+      oslide_close_handles(oslide);
+      return 1;
+    }
+  }
+  oslide->handle_count = count;
   return 0;
 }
 
+void oslide_close_handles(oslide_t *oslide) {
+  for (int i = 0; i < oslide->handle_count; i++) {
+    if (oslide->handles[i]) {
+      openslide_close(oslide->handles[i]);
+    }
+  }
+  free(oslide->handles);
+  oslide->handles = NULL;
+  oslide->handle_count = 0;
+}
+
+// One worker of read_regions_parallel / read_regions_scheduled
+typedef struct read_worker_t {
+  pthread_t thread;
+  int id;
+  schedule_t *schedule; // NULL -> next unread request
+  oslide_t *oslide;
+  openslide_t *osr;
+  request_t *requests;
+  image_t *regions;
+  int64_t n;
+  int64_t *next; // shared, atomic
+  int64_t failed;
+} read_worker_t;
+
+static void *read_worker(void *arg) {
+  read_worker_t *worker = arg;
+  // Bound once, so reads don't rebind per request
+  TRACE_BIND(worker->oslide->trace, previous_trace);
+  for (;;) {
+    int64_t i = worker->schedule
+                    ? schedule_next(worker->schedule, worker->id)
+                    : __atomic_fetch_add(worker->next, 1, __ATOMIC_RELAXED);
+    if ((i < 0) | (i >= worker->n)) {
+      break;
+    }
+    worker->failed += oslide_read_region_with(worker->oslide, worker->osr,
+                                              &worker->regions[i],
+                                              worker->requests[i],
+                                              worker->oslide->arenas[worker->id]);
+  }
+  TRACE_UNBIND(previous_trace);
+  return NULL;
+}
+
+static int64_t read_regions_workers(oslide_t *oslide, request_t *requests,
+                                   image_t *regions, int64_t n, int n_threads,
+                                   schedule_t *schedule) {
+  openslide_t *osr = oslide_osr(oslide);
+  read_worker_t *workers = calloc(n_threads, sizeof(read_worker_t));
+  if (!osr || !workers || oslide_reserve_arenas(oslide, n_threads)) {
+    free(workers);
+    return n;
+  }
+
+  int64_t next = 0;
+  for (int t = 0; t < n_threads; t++) {
+    workers[t] = (read_worker_t){
+        .id = t,
+        .schedule = schedule,
+        .oslide = oslide,
+        .osr = oslide->handle_count > 0
+                   ? oslide->handles[t % oslide->handle_count]
+                   : osr,
+        .requests = requests,
+        .regions = regions,
+        .n = n,
+        .next = &next,
+    };
+  }
+
+  // Calling thread is worker 0. Workers that could not be started run on
+  // it afterwards: a round robin schedule has no stealing, so nobody else
+  // would read their requests ( otherwise they find nothing left ).
+  int started = 1;
+  while (started < n_threads) {
+    if (pthread_create(&workers[started].thread, NULL, read_worker,
+                       &workers[started])) {
+      break;
+    }
+    started++;
+  }
+  read_worker(&workers[0]);
+  for (int t = 1; t < started; t++) {
+    pthread_join(workers[t].thread, NULL);
+  }
+  for (int t = started; t < n_threads; t++) {
+    read_worker(&workers[t]);
+  }
+
+  int64_t failed = 0;
+  for (int t = 0; t < n_threads; t++) {
+    failed += workers[t].failed;
+  }
+  free(workers);
+  return failed;
+}
+
+int64_t read_regions_parallel(oslide_t *oslide, request_t *requests,
+                              image_t *regions, int64_t n, int n_threads) {
+  if (n_threads <= 0) {
+    n_threads = oslide->handle_count > 0 ? oslide->handle_count : 1;
+  }
+  return read_regions_workers(oslide, requests, regions, n, n_threads, NULL);
+}
+
+int64_t read_regions_scheduled(oslide_t *oslide, request_t *requests,
+                               image_t *regions, schedule_t *schedule) {
+  return read_regions_workers(oslide, requests, regions,
+                              schedule->n_requests, schedule->n_workers,
+                              schedule);
+}
+
+int oslide_set_cache(oslide_t *oslide, size_t max_bytes) {
+  tile_cache_free(oslide->cache);
+  oslide->cache = NULL;
+  if (max_bytes == 0) {
+    return 0;
+  }
+  oslide->cache = tile_cache_new(max_bytes, TILE_CACHE_BLOCK_SIZE);
+  return oslide->cache == NULL;
+}
+
+tile_cache_stats_t oslide_cache_stats(oslide_t *oslide) {
+  if (!oslide->cache) {
+    tile_cache_stats_t stats = {0};
+    return stats;
+  }
+  return tile_cache_stats(oslide->cache);
+}
+
 void print_request(request_t request) {
   printf("Request:\n"
          "  location: %7ld, %7ld\n"
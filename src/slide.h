@@ -1,4 +1,10 @@
+#pragma once
+
+#include "cache.h"
+#include "descriptor.h"
 #include "ops.h"
+#include "schedule.h"
+#include "trace.h"
 #include <math.h>
 #include <openslide/openslide.h>
 #include <stdint.h>
@@ -6,12 +12,36 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Blocks kept by each per-thread arena: padded region, resampler temporary
+// and output, with one to spare
+#define OSLIDE_ARENA_BLOCKS_MAX 4
+
+// Summed stats of the per-thread arenas, see ImagingMemoryArena
+typedef struct arena_stats_t {
+  int64_t new_count; // images
+  int64_t allocated_blocks;
+  int64_t reused_blocks;
+  int64_t reallocated_blocks;
+  int64_t freed_blocks;
+  int64_t blocks_cached; // currently pooled
+} arena_stats_t;
+
+struct ImagingMemoryArena;
+
 // Main struct to hold everything
 typedef struct oslide_t {
   char *path;
-  openslide_t *osr;
+  openslide_t *osr; // NULL until needed, if opened from a cached descriptor
+  char quickhash[OSLIDE_QUICKHASH_SIZE];
   slide_props_t slide_props;
   level_props_t level_props;
+  tile_cache_t *cache; // NULL -> read straight from openslide
+  openslide_t **handles; // extra handles for parallel reads
+  int handle_count;
+  struct ImagingMemoryArena **arenas; // one per worker, 0 for oslide_read_region
+  int arena_count;
+  int arena_blocks_max;
+  trace_t *trace;
 } oslide_t;
 
 // Open, close
@@ -19,6 +49,18 @@ oslide_t oslide_open(char *path);
 void oslide_close(oslide_t *oslide);
 void oslide_print(oslide_t *oslide);
 
+// Same as oslide_open, but slide and level props come from a descriptor in
+// cache_dir when there is one, without opening the slide: planning ( requests,
+// tilings, batches ) never touches openslide. On a miss the slide is opened
+// and its descriptor written for next time. cache_dir NULL -> oslide_open
+oslide_t oslide_open_cached(char *path, const char *cache_dir);
+
+// Slide's openslide handle, opened on first use, if it was not yet. NULL if
+// it cannot be opened, or its quickhash does not match the descriptor's.
+// Reads call it before starting any worker.
+// NOTE: Not thread safe, call once before sharing the slide between threads
+openslide_t *oslide_osr(oslide_t *oslide);
+
 // --- Extensions to openslide_t ---
 
 // Images
@@ -34,7 +76,13 @@ dpos_t osr_spacings(openslide_t *osr); // mpp_x, mpp_y
 ipos_t osr_size(openslide_t *osr);
 ipos_t osr_offset(openslide_t *osr);
 ipos_t osr_bounds(openslide_t *osr);
-double osr_scaling(openslide_t *osr, double mpp); // TODO:
+double osr_scaling(openslide_t *osr, double mpp); // scaling to reach mpp
+
+// openslide.quickhash-1, NULL if none
+const char *osr_quickhash(openslide_t *osr);
+
+// background stuff
+uint32_t osr_background_color(openslide_t *osr); // 0xRRGGBB
 
 // level stuff - putting in output for mem management
 void osr_level_downsamples(openslide_t *osr, int level_count,
@@ -47,11 +95,135 @@ int is_valid_region(ipos_t location, double scaling, ipos_t size,
                     level_props_t level_props);
 request_t read_region_request(ipos_t location, double scaling, ipos_t size,
                               openslide_t *osr, level_props_t level_props);
+
+// Same as openslide_get_best_level_for_downsample, from level_props only
+int best_level_for_downsample(level_props_t level_props, double downsample);
+
+// Same as read_region_request, split into per-level and per-tile parts.
+// osr NULL -> level from best_level_for_downsample
+native_level_t native_level_request(double scaling, openslide_t *osr,
+                                    level_props_t level_props);
+request_t native_region_request(ipos_t location, ipos_t size,
+                                native_level_t native_level);
+
+// Per-level params of a given level, whichever way it was chosen
+native_level_t native_level_at(int level, double scaling,
+                               level_props_t level_props);
+
+// Level for size tiles at scaling, by estimated cost ( native pixels read
+// plus resample taps ) among the levels within policy's quality bound, and
+// why. Just below a level boundary, openslide's level reads up to 4x the
+// pixels of the next one; a bound above 1 trades a slight upsample for that.
+// policy NULL -> openslide's level, LEVEL_REASON_DEFAULT
+level_choice_t choose_level(double scaling, ipos_t size,
+                            const level_policy_t *policy, openslide_t *osr,
+                            level_props_t level_props);
+const char *level_reason_name(level_reason_t reason);
+
+// Level of a tiling, by its policy, as used by read_region_requests,
+// read_region_records and request_batch_tiling. choice may be NULL
+native_level_t tiling_native_level(tiling_t tiling, openslide_t *osr,
+                                   level_props_t level_props,
+                                   level_choice_t *choice);
+
+// Same, exact: scaling and downsamples are ratios, and all integer outputs
+// come from 64 bit integer math ( 128 bit products ). Bit reproducible, so
+// identical tiles always map to identical native regions ( and cache
+// blocks ). Downsamples are computed from level_props' dimensions, as
+// openslide does. See rational_from_double for a scaling given as double.
+native_level_exact_t native_level_exact(int level, rational_t scaling,
+                                        level_props_t level_props);
+native_level_exact_t native_level_request_exact(rational_t scaling,
+                                                openslide_t *osr,
+                                                level_props_t level_props);
+request_t native_region_request_exact(ipos_t location, ipos_t size,
+                                      native_level_exact_t native_level);
+request_t read_region_request_exact(ipos_t location, rational_t scaling,
+                                    ipos_t size, openslide_t *osr,
+                                    level_props_t level_props);
+
+// Batch - all requests of a tiling grid, level params computed once
+// NOTE: Remember to free
+ipos_t tiling_grid_size(tiling_t tiling, level_props_t level_props);
+// Valid locations of the grid, row major, x varies fastest ( same order as
+// requests.csv ), as walked by read_region_requests, read_region_records and
+// request_batch_tiling. tiling_grid_next returns 0 past the last one
+void tiling_grid_init(tiling_grid_t *grid, tiling_t tiling,
+                      level_props_t level_props);
+int tiling_grid_next(tiling_grid_t *grid, ipos_t *location);
+request_t *read_region_requests(tiling_t tiling, openslide_t *osr,
+                                level_props_t level_props, int64_t *n_requests);
+
+// Same, with the read_region args of each request, into records of at least
+// tiling_grid_size.x * .y. Returns the number written
+int64_t read_region_records(tiling_t tiling, openslide_t *osr,
+                            level_props_t level_props,
+                            request_record_t *records);
+
 void print_request(request_t request);
 
 // NOTE: Actual sauce, read and resize
+// region->format RGB or CHW: 3 bands, alpha composited over
+// region->background ( e.g. slide_props.background ) in the final conversion
 int read_region(image_t *region, openslide_t *osr, request_t request);
 
+// Same, for large regions: the padded region is read in strips of
+// strip_rows native rows, each streamed through the resampler, so memory is
+// one strip plus a ring of filter support rows instead of the whole padded
+// region and horizontal pass. Strips are on the native pixel grid, as with
+// the tile cache: levels with a non integral downsample go through
+// read_region instead.
+int read_region_streamed(image_t *region, openslide_t *osr, request_t request,
+                         int strip_rows);
+
+// Requests whose padded region is entirely outside openslide.bounds-* have
+// nothing to decode ( sparse formats like MIRAX ): fill them with the
+// opaque background color instead of going through openslide and resample.
+int is_background_request(request_t request, slide_props_t slide_props,
+                          level_props_t level_props);
+void fill_background(image_t *region, uint32_t color); // 0xRRGGBB, any format
+
+// Same as read_region, through the slide's tile cache when one is set, and
+// short-circuiting background requests
+int oslide_read_region(oslide_t *oslide, image_t *region, request_t request);
+
+// Tile cache of decoded native blocks, shared by overlapping requests.
+// Output is identical to read_region: levels with a non integral downsample
+// ( e.g. most svs ) are read straight from openslide.
+// max_bytes == 0 -> no cache
+int oslide_set_cache(oslide_t *oslide, size_t max_bytes);
+tile_cache_stats_t oslide_cache_stats(oslide_t *oslide);
+
+// Buffers of reads come from per-thread arenas, pooling up to blocks_max
+// blocks each ( 0 -> malloc / free every read ). Stats allow checking that
+// steady state reads reuse blocks only.
+int oslide_set_arenas(oslide_t *oslide, int blocks_max);
+arena_stats_t oslide_arena_stats(oslide_t *oslide);
+
+// Parallel reads. openslide_t is thread safe, but all reads through one
+// handle share its tile cache and locks, so each worker gets its own handle
+// from the pool, if opened. The tile cache is shared by all workers.
+// NOTE: Handles are closed by oslide_close
+int oslide_open_handles(oslide_t *oslide, int count);
+void oslide_close_handles(oslide_t *oslide);
+
+// Read requests[i] into regions[i] on n_threads workers ( <= 0 -> one per
+// handle ), each with its own arena. Returns number of failed reads
+// NOTE: regions[i].data is expected to be allocated
+int64_t read_regions_parallel(oslide_t *oslide, request_t *requests,
+                              image_t *regions, int64_t n, int n_threads);
+
+// Same, on schedule->n_workers workers in the schedule's order, see
+// schedule_new. Requests sharing native tiles go to the same worker.
+int64_t read_regions_scheduled(oslide_t *oslide, request_t *requests,
+                               image_t *regions, schedule_t *schedule);
+
+// Per-stage latency histograms of reads through the slide, summed over
+// threads. Empty unless built with -DOSLIDE_TRACE ( meson -Dtrace=true )
+trace_stats_t oslide_trace_stats(oslide_t *oslide);
+void oslide_trace_dump(oslide_t *oslide, FILE *fp);
+void oslide_trace_reset(oslide_t *oslide);
+
 // Helpers to dump to csv
 void print_lss_header(void);
 void print_lss_row(ipos_t location, double scaling, ipos_t size);
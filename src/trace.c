@@ -0,0 +1,172 @@
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *stage_names[TRACE_STAGES] = {
+    "read_region", "decode",   "convert", "coeffs",
+    "horizontal",  "vertical", "resize",
+};
+
+static trace_t default_trace = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Sink of the calling thread, and its histograms in there
+static __thread trace_t *thread_trace = NULL;
+static __thread trace_thread_t *thread_stats = NULL;
+
+trace_t *trace_new(void) {
+  trace_t *trace = calloc(1, sizeof(trace_t));
+  if (trace) {
+    pthread_mutex_init(&trace->lock, NULL);
+  }
+  return trace;
+}
+
+void trace_free(trace_t *trace) {
+  if (!trace) {
+    return;
+  }
+  trace_thread_t *stats = trace->threads;
+  while (stats) {
+    trace_thread_t *next = stats->next;
+    free(stats);
+    stats = next;
+  }
+  pthread_mutex_destroy(&trace->lock);
+  free(trace);
+}
+
+trace_t *trace_get(void) { return thread_trace ? thread_trace : &default_trace; }
+
+// Histograms of the calling thread in trace, created on first use.
+// Kept after the thread exits, so workers' spans are still counted.
+static trace_thread_t *trace_thread_stats(trace_t *trace) {
+  pthread_t self = pthread_self();
+  pthread_mutex_lock(&trace->lock);
+  trace_thread_t *stats = trace->threads;
+  while (stats && !pthread_equal(stats->thread, self)) {
+    stats = stats->next;
+  }
+  if (!stats && (stats = calloc(1, sizeof(trace_thread_t)))) {
+    stats->thread = self;
+    stats->next = trace->threads;
+    trace->threads = stats;
+  }
+  pthread_mutex_unlock(&trace->lock);
+  return stats;
+}
+
+void trace_set(trace_t *trace) {
+  if (!trace) {
+    trace = &default_trace;
+  }
+  if (trace == thread_trace) {
+    return;
+  }
+  thread_trace = trace;
+  thread_stats = trace_thread_stats(trace);
+}
+
+// Quarter octave of ns, see TRACE_BUCKETS
+static int trace_bucket(int64_t ns) {
+  if (ns < 4) {
+    return ns < 0 ? 0 : ns;
+  }
+  int octave = 63 - __builtin_clzll(ns);
+  int bucket = octave * 4 + ((ns >> (octave - 2)) & 3);
+  return bucket < TRACE_BUCKETS ? bucket : TRACE_BUCKETS - 1;
+}
+
+static int64_t trace_bucket_start(int bucket) {
+  if (bucket < 4) {
+    return bucket;
+  }
+  return (int64_t)(4 + bucket % 4) << (bucket / 4 - 2);
+}
+
+// Single writer: plain increments, atomic so readers see whole values
+static inline void trace_add(int64_t *value, int64_t n) {
+  __atomic_store_n(value, *value + n, __ATOMIC_RELAXED);
+}
+
+void trace_record(trace_stage_t stage, int64_t ns) {
+  if (!thread_stats) {
+    trace_set(trace_get());
+    if (!thread_stats) {
+      return;
+    }
+  }
+  trace_histogram_t *histogram = &thread_stats->stats.stages[stage];
+  trace_add(&histogram->count, 1);
+  trace_add(&histogram->total_ns, ns);
+  if (ns > histogram->max_ns) {
+    __atomic_store_n(&histogram->max_ns, ns, __ATOMIC_RELAXED);
+  }
+  trace_add(&histogram->buckets[trace_bucket(ns)], 1);
+}
+
+trace_stats_t trace_stats(trace_t *trace) {
+  trace_stats_t stats;
+  memset(&stats, 0, sizeof(trace_stats_t));
+  pthread_mutex_lock(&trace->lock);
+  for (trace_thread_t *t = trace->threads; t; t = t->next) {
+    for (int s = 0; s < TRACE_STAGES; s++) {
+      trace_histogram_t *from = &t->stats.stages[s];
+      trace_histogram_t *to = &stats.stages[s];
+      to->count += __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+      to->total_ns += __atomic_load_n(&from->total_ns, __ATOMIC_RELAXED);
+      int64_t max_ns = __atomic_load_n(&from->max_ns, __ATOMIC_RELAXED);
+      to->max_ns = max_ns > to->max_ns ? max_ns : to->max_ns;
+      for (int b = 0; b < TRACE_BUCKETS; b++) {
+        to->buckets[b] += __atomic_load_n(&from->buckets[b], __ATOMIC_RELAXED);
+      }
+    }
+  }
+  pthread_mutex_unlock(&trace->lock);
+  return stats;
+}
+
+void trace_reset(trace_t *trace) {
+  pthread_mutex_lock(&trace->lock);
+  for (trace_thread_t *t = trace->threads; t; t = t->next) {
+    for (int s = 0; s < TRACE_STAGES; s++) {
+      trace_histogram_t *histogram = &t->stats.stages[s];
+      __atomic_store_n(&histogram->count, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&histogram->total_ns, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&histogram->max_ns, 0, __ATOMIC_RELAXED);
+      for (int b = 0; b < TRACE_BUCKETS; b++) {
+        __atomic_store_n(&histogram->buckets[b], 0, __ATOMIC_RELAXED);
+      }
+    }
+  }
+  pthread_mutex_unlock(&trace->lock);
+}
+
+int64_t trace_percentile(trace_histogram_t *histogram, double q) {
+  if (!histogram->count) {
+    return 0;
+  }
+  int64_t rank = q * (histogram->count - 1), seen = 0;
+  for (int b = 0; b < TRACE_BUCKETS; b++) {
+    seen += histogram->buckets[b];
+    if (seen > rank) {
+      return trace_bucket_start(b);
+    }
+  }
+  return histogram->max_ns;
+}
+
+void trace_dump(trace_stats_t *stats, FILE *fp) {
+  fprintf(fp, "%-12s %10s %12s %12s %12s %12s\n", "stage", "count",
+          "mean_us", "p50_us", "p99_us", "max_us");
+  for (int s = 0; s < TRACE_STAGES; s++) {
+    trace_histogram_t *histogram = &stats->stages[s];
+    if (!histogram->count) {
+      continue;
+    }
+    fprintf(fp, "%-12s %10ld %12.2f %12.2f %12.2f %12.2f\n", stage_names[s],
+            histogram->count, histogram->total_ns * 1e-3 / histogram->count,
+            trace_percentile(histogram, 0.50) * 1e-3,
+            trace_percentile(histogram, 0.99) * 1e-3,
+            histogram->max_ns * 1e-3);
+  }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Stages of a read, timed when built with -DOSLIDE_TRACE ( meson -Dtrace )
+typedef enum trace_stage_t {
+  TRACE_READ_REGION, // whole read, includes everything below
+  TRACE_DECODE,      // openslide_read_region, or the tile cache
+  TRACE_CONVERT,     // ARGB / premultiplied conversions around the resample
+  TRACE_COEFFS,      // ImagingResampleInner coefficients, cached or not
+  TRACE_HORIZONTAL,  // ImagingResampleInner passes
+  TRACE_VERTICAL,
+  TRACE_RESIZE, // image_resize, through vips
+  TRACE_STAGES,
+} trace_stage_t;
+
+// Quarter octaves of nanoseconds, ~19% wide, up to ~10^12 ns
+#define TRACE_BUCKETS 160
+
+typedef struct trace_histogram_t {
+  int64_t count;
+  int64_t total_ns;
+  int64_t max_ns;
+  int64_t buckets[TRACE_BUCKETS];
+} trace_histogram_t;
+
+typedef struct trace_stats_t {
+  trace_histogram_t stages[TRACE_STAGES];
+} trace_stats_t;
+
+// Histograms of one thread, written by that thread only
+typedef struct trace_thread_t {
+  pthread_t thread;
+  trace_stats_t stats;
+  struct trace_thread_t *next;
+} trace_thread_t;
+
+// Where spans go: one set of histograms per thread that recorded into it
+typedef struct trace_t {
+  pthread_mutex_t lock;
+  trace_thread_t *threads;
+} trace_t;
+
+// NOTE: Remember to free
+trace_t *trace_new(void);
+void trace_free(trace_t *trace);
+
+// Spans of the calling thread go to trace, NULL -> the default one
+trace_t *trace_get(void);
+void trace_set(trace_t *trace);
+
+// Sum of all threads' histograms, and reset them all
+trace_stats_t trace_stats(trace_t *trace);
+void trace_reset(trace_t *trace);
+
+// Lower bound of the bucket holding quantile q ( 0 - 1 ), in ns
+int64_t trace_percentile(trace_histogram_t *histogram, double q);
+
+// One line per stage that was hit: count, mean, p50, p99, max
+void trace_dump(trace_stats_t *stats, FILE *fp);
+
+static inline int64_t trace_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void trace_record(trace_stage_t stage, int64_t ns);
+
+// Instrumentation points, nothing left when tracing is off
+#ifdef OSLIDE_TRACE
+#define TRACE_BEGIN(span) int64_t span = trace_now()
+#define TRACE_END(span, stage) trace_record((stage), trace_now() - (span))
+#define TRACE_BIND(trace, previous)                                           \
+  trace_t *previous = trace_get();                                             \
+  trace_set(trace)
+#define TRACE_UNBIND(previous) trace_set(previous)
+#else
+#define TRACE_BEGIN(span)
+#define TRACE_END(span, stage)
+#define TRACE_BIND(trace, previous)
+#define TRACE_UNBIND(previous)
+#endif
@@ -19,14 +19,33 @@ typedef struct dpos_t {
   double x, y;
 } dpos_t;
 
+// Exact num / den, den > 0
+typedef struct rational_t {
+  int64_t num, den;
+} rational_t;
+
 typedef struct dbox_t {
   double x1, y1, x2, y2;
 } dbox_t;
 
 // Images
+typedef enum image_format_t {
+  IMAGE_RGBA = 0, // 4 * uint8 per pixel, interleaved
+  IMAGE_RGB,      // 3 * uint8 per pixel, interleaved
+  IMAGE_CHW,      // 3 planes of width * height uint8: R, G, then B
+} image_format_t;
+
 typedef struct image_t {
   int width, height, bands;
-  uint32_t *data; // From openslide -> ARGB, 4 * uint8
+  uint32_t *data; // From openslide -> ARGB, 4 * uint8. Bytes for RGB, CHW
+  // Layout reads and resamples write. RGB and CHW have no alpha: it is
+  // composited over background ( 0xRRGGBB, e.g. slide_props.background )
+  // by the final conversion, so callers never get a 4th band.
+  // NOTE: Output only. Decoding and both resample passes still run on 4
+  // bytes per pixel, so RGB and CHW save memory and bandwidth downstream of
+  // a read, not inside it.
+  image_format_t format;
+  uint32_t background;
 } image_t;
 
 // Associated Images
@@ -48,6 +67,7 @@ typedef struct slide_props_t {
   double magnification;
   dpos_t spacings;
   ipos_t size, offset, bounds;
+  uint32_t background; // 0xRRGGBB
 } slide_props_t;
 
 // Level dims, downsamples, etc.
@@ -71,3 +91,82 @@ typedef struct request_t {
   ipos_t size;
   native_t native;
 } request_t;
+
+// One row of requests.csv: the read_region args and their request
+typedef struct request_record_t {
+  ipos_t location;
+  double scaling;
+  ipos_t size;
+  request_t request;
+} request_record_t;
+
+// Per-level params, shared by every request at a given scaling
+typedef struct native_level_t {
+  int level;
+  ipos_t size;
+  double downsample;
+  double scaling;
+  double extra_pixels;
+} native_level_t;
+
+// Same, as exact ratios, see native_level_request_exact
+typedef struct native_level_exact_t {
+  int level;
+  ipos_t size;
+  rational_t downsample; // level 0 / level size, mean of both axes
+  rational_t scaling;    // scaling * downsample
+  int64_t extra_pixels;
+} native_level_exact_t;
+
+// Level selection by estimated cost per tile, see choose_level. Costs are
+// relative: read_cost per native pixel decoded, resample_cost per filter tap.
+typedef struct level_policy_t {
+  // Quality bound: native scaling <= max_upsample, so 1.0 never upsamples
+  // ( openslide's level ), 1.05 allows reading a coarser level just below
+  // a level boundary and upsampling by up to 5%, 0.5 asks for at least
+  // twice the pixels of the output from a finer level
+  double max_upsample;
+  double read_cost;
+  double resample_cost;
+} level_policy_t;
+
+#define LEVEL_POLICY_DEFAULT                                                   \
+  ((level_policy_t){                                                          \
+      .max_upsample = 1.0, .read_cost = 1.0, .resample_cost = 0.1})
+
+typedef enum level_reason_t {
+  LEVEL_REASON_DEFAULT,  // no policy, openslide's best level
+  LEVEL_REASON_CHEAPEST, // cheapest within the bound, openslide's level
+  LEVEL_REASON_UPSAMPLE, // cheapest within the bound, coarser than openslide's
+  LEVEL_REASON_FINEST,   // none within the bound, level 0
+  LEVEL_REASON_BOUND,    // cheapest within the bound, finer than openslide's
+} level_reason_t;
+
+// Chosen level, why, and its estimated cost per tile against openslide's
+typedef struct level_choice_t {
+  int level;
+  level_reason_t reason;
+  double cost;
+  double native_pixels;
+  double resample_taps;
+  int default_level;
+  double default_cost;
+} level_choice_t;
+
+// Grid of tiles at a given scaling, in scaled coordinates ( dlup skip mode )
+typedef struct tiling_t {
+  double scaling;
+  ipos_t tile_size;
+  ipos_t overlap;
+  ipos_t roi_location;
+  ipos_t roi_size; // {0, 0} -> whole level
+  const level_policy_t *policy; // NULL -> openslide's level
+} tiling_t;
+
+// Walk over a tiling's valid locations, see tiling_grid_next
+typedef struct tiling_grid_t {
+  tiling_t tiling;
+  level_props_t level_props;
+  ipos_t size, stride;
+  ipos_t next; // grid position of the next location
+} tiling_grid_t;
@@ -0,0 +1,143 @@
+#include "vimage.h"
+#include "resize.h"
+
+// Shared by all sequences of one image
+typedef struct vimage_t {
+  oslide_t *oslide;
+  native_level_t native_level;
+  int sequences; // started, to spread them over the handle pool
+} vimage_t;
+
+// One per vips worker thread
+typedef struct vimage_seq_t {
+  openslide_t *osr;
+  struct ImagingMemoryArena arena;
+  image_t chunk;
+} vimage_seq_t;
+
+static void *vimage_start(VipsImage *out, void *a, void *b) {
+  vimage_t *vimage = a;
+  oslide_t *oslide = vimage->oslide;
+  (void)out;
+  (void)b;
+
+  vimage_seq_t *seq = calloc(1, sizeof(vimage_seq_t));
+  if (!seq) {
+    return NULL;
+  }
+  seq->chunk.data =
+      malloc(VIMAGE_CHUNK_SIZE * VIMAGE_CHUNK_SIZE * sizeof(uint32_t));
+  if (!seq->chunk.data) {
+    free(seq);
+    return NULL;
+  }
+  int n = __atomic_fetch_add(&vimage->sequences, 1, __ATOMIC_RELAXED);
+  seq->osr = oslide->handle_count > 0
+                 ? oslide->handles[n % oslide->handle_count]
+                 : oslide->osr;
+  ImagingMemoryArenaInit(&seq->arena, OSLIDE_ARENA_BLOCKS_MAX);
+  return seq;
+}
+
+// Fill the region in chunks, so memory does not depend on what vips asks
+static int vimage_generate(VipsRegion *out, void *vseq, void *a, void *b,
+                           gboolean *stop) {
+  vimage_seq_t *seq = vseq;
+  vimage_t *vimage = a;
+  VipsRect *r = &out->valid;
+  (void)b;
+  (void)stop;
+
+  ImagingMemoryArena previous = ImagingGetArena();
+  ImagingSetArena(&seq->arena);
+  TRACE_BIND(vimage->oslide->trace, previous_trace);
+  int err = 0;
+  for (int top = r->top; (top < VIPS_RECT_BOTTOM(r)) & !err;
+       top += VIMAGE_CHUNK_SIZE) {
+    for (int left = r->left; (left < VIPS_RECT_RIGHT(r)) & !err;
+         left += VIMAGE_CHUNK_SIZE) {
+      ipos_t location = {.x = left, .y = top};
+      ipos_t size = {.x = MIN(VIMAGE_CHUNK_SIZE, VIPS_RECT_RIGHT(r) - left),
+                     .y = MIN(VIMAGE_CHUNK_SIZE, VIPS_RECT_BOTTOM(r) - top)};
+      request_t request =
+          native_region_request(location, size, vimage->native_level);
+
+      seq->chunk.width = size.x;
+      seq->chunk.height = size.y;
+      seq->chunk.bands = 4;
+      if (is_background_request(request, vimage->oslide->slide_props,
+                                vimage->oslide->level_props)) {
+        fill_background(&seq->chunk, vimage->oslide->slide_props.background);
+      } else {
+        err = read_region(&seq->chunk, seq->osr, request);
+      }
+
+      for (int y = 0; (y < size.y) & !err; y++) {
+        memcpy(VIPS_REGION_ADDR(out, left, top + y),
+               &seq->chunk.data[y * size.x], size.x * sizeof(uint32_t));
+      }
+    }
+  }
+  TRACE_UNBIND(previous_trace);
+  ImagingSetArena(previous);
+  return err ? -1 : 0;
+}
+
+static int vimage_stop(void *vseq, void *a, void *b) {
+  vimage_seq_t *seq = vseq;
+  (void)a;
+  (void)b;
+  ImagingMemoryArenaRelease(&seq->arena);
+  free(seq->chunk.data);
+  free(seq);
+  return 0;
+}
+
+static void vimage_close(VipsImage *image, vimage_t *vimage) {
+  (void)image;
+  free(vimage);
+}
+
+VipsImage *oslide_vips_image(oslide_t *oslide, double scaling) {
+  if (VIPS_INIT("c-vips-openslide") || (scaling <= 0.0)) {
+    return NULL;
+  }
+  // Before vips starts any sequence
+  openslide_t *osr = oslide_osr(oslide);
+  if (!osr) {
+    return NULL;
+  }
+  vimage_t *vimage = calloc(1, sizeof(vimage_t));
+  if (!vimage) {
+    return NULL;
+  }
+  vimage->oslide = oslide;
+  vimage->native_level =
+      native_level_request(scaling, osr, oslide->level_props);
+
+  // Same size as is_valid_region allows, resolution in pixels per mm
+  ipos_t size = get_scaled_size(oslide->level_props.slide_size, scaling);
+  double res = oslide->slide_props.mpp > 0.0
+                   ? 1000.0 * scaling / oslide->slide_props.mpp
+                   : 1.0;
+
+  VipsImage *image = vips_image_new();
+  g_signal_connect(image, "close", G_CALLBACK(vimage_close), vimage);
+  vips_image_init_fields(image, size.x, size.y, 4, VIPS_FORMAT_UCHAR,
+                         VIPS_CODING_NONE, VIPS_INTERPRETATION_sRGB, res, res);
+
+  // Like vips' openslideload
+  const char *const *names = openslide_get_property_names(osr);
+  for (int i = 0; names && names[i]; i++) {
+    vips_image_set_string(image, names[i],
+                          openslide_get_property_value(osr, names[i]));
+  }
+
+  if (vips_image_pipelinev(image, VIPS_DEMAND_STYLE_SMALLTILE, NULL) ||
+      vips_image_generate(image, vimage_start, vimage_generate, vimage_stop,
+                          vimage, NULL)) {
+    g_object_unref(image);
+    return NULL;
+  }
+  return image;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "slide.h"
+#include <vips/vips.h>
+
+// Largest region read at once, output pixels per side
+#define VIMAGE_CHUNK_SIZE 512
+
+// Lazy RGBA ( uchar, straight alpha ) image of the whole slide at scaling,
+// of get_scaled_size(slide size, scaling). Nothing is read until a vips
+// pipeline ( vips_extract_area, vips_resize, save, ... ) demands pixels:
+// each demanded region is then read with read_region_request + read_region,
+// in chunks, on vips' threadpool, so no level is ever materialized.
+// Regions start at their exact fractional native location, so pixels do
+// not depend on how vips tiles the image.
+// Openslide properties are copied as image metadata, resolution from mpp.
+// NOTE: Remember to g_object_unref, the slide must outlive the image
+// NOTE: Worker threads use the slide's handle pool, if opened
+VipsImage *oslide_vips_image(oslide_t *oslide, double scaling);
@@ -0,0 +1,219 @@
+// Stages of read_region over a synthetic pyramidal TIFF, as JSON
+// usage: bench-pipeline <dir> [slide size] [tile size] [scaling]
+// The slide is generated with vips in <dir> on the first run, then reused.
+// Allocations are counted by wrapping glibc's malloc, calloc and realloc.
+#include "resize.h"
+#include "synthetic_slide.h"
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+// Allocations so far: malloc, calloc and realloc calls of the whole process
+// ( openslide, vips and glib included ), and the bytes they asked for
+typedef struct allocs_t {
+  int64_t count;
+  int64_t bytes;
+} allocs_t;
+
+static allocs_t allocs;
+
+#ifdef __GLIBC__
+// Counted, then forwarded to glibc's allocator
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static void count_alloc(size_t size) {
+  __atomic_add_fetch(&allocs.count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&allocs.bytes, (int64_t)size, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+  count_alloc(size);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  count_alloc(n * size);
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  count_alloc(size);
+  return __libc_realloc(ptr, size);
+}
+#endif
+
+static allocs_t allocs_now(void) {
+  allocs_t now = {.count = __atomic_load_n(&allocs.count, __ATOMIC_RELAXED),
+                  .bytes = __atomic_load_n(&allocs.bytes, __ATOMIC_RELAXED)};
+  return now;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Stages, each timed on its own
+enum { REQUEST, RAW_READ, ARGB2RGBA, RESAMPLE, READ_REGION, STAGES };
+static const char *stage_names[STAGES] = {"request", "raw_read", "argb2rgba",
+                                          "resample", "read_region"};
+
+typedef struct stage_t {
+  double *seconds; // per tile
+  allocs_t allocs; // all tiles
+} stage_t;
+
+static void add_allocs(stage_t *stage, allocs_t before, allocs_t after) {
+  stage->allocs.count += after.count - before.count;
+  stage->allocs.bytes += after.bytes - before.bytes;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+static void print_stage(stage_t *stage, const char *name, int64_t n,
+                        int last) {
+  double total = 0.0;
+  for (int64_t i = 0; i < n; i++) {
+    total += stage->seconds[i];
+  }
+  qsort(stage->seconds, n, sizeof(double), compare_doubles);
+  printf("    \"%s\": {\"tiles_per_sec\": %.1f, \"p50_us\": %.2f, "
+         "\"p99_us\": %.2f, \"allocs_per_tile\": %.2f, "
+         "\"bytes_per_tile\": %" PRId64 "}%s\n",
+         name, n / total, stage->seconds[n / 2] * 1e6,
+         stage->seconds[MIN(n - 1, n * 99 / 100)] * 1e6,
+         (double)stage->allocs.count / n, stage->allocs.bytes / n,
+         last ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("usage: %s <dir> [slide size] [tile size] [scaling]\n", argv[0]);
+    return 1;
+  }
+  int slide_size = argc > 2 ? atoi(argv[2]) : 8192;
+  int tile_size = argc > 3 ? atoi(argv[3]) : 256;
+  double scaling = argc > 4 ? atof(argv[4]) : 0.2495;
+
+  if (VIPS_INIT(argv[0])) {
+    return 1;
+  }
+  char path[4096];
+  oslide_t oslide;
+  if (synthetic_slide_open(&oslide, path, sizeof(path), argv[1], slide_size)) {
+    return 1;
+  }
+
+  // Tiling grid, as the batch API would issue it
+  ipos_t size = {.x = tile_size, .y = tile_size};
+  tiling_t tiling = {.scaling = scaling, .tile_size = size};
+  ipos_t grid_size = tiling_grid_size(tiling, oslide.level_props);
+  request_record_t *records =
+      malloc(MAX(grid_size.x * grid_size.y, 1) * sizeof(request_record_t));
+  int64_t n =
+      read_region_records(tiling, oslide.osr, oslide.level_props, records);
+  if (!n) {
+    fprintf(stderr, "no tiles\n");
+    return 1;
+  }
+
+  stage_t stages[STAGES] = {0};
+  for (int s = 0; s < STAGES; s++) {
+    stages[s].seconds = malloc(n * sizeof(double));
+  }
+  image_t region = {.width = size.x,
+                    .height = size.y,
+                    .bands = 4,
+                    .data = malloc(size.x * size.y * sizeof(uint32_t))};
+
+  // Pipeline split in stages, one tile at a time, timed and with the
+  // allocations made in each
+  int err = 0;
+  for (int64_t i = 0; (i < n) & !err; i++) {
+    allocs_t a0 = allocs_now();
+    double t0 = now();
+    request_t request = read_region_request(
+        records[i].location, scaling, size, oslide.osr, oslide.level_props);
+    double t1 = now();
+    allocs_t a1 = allocs_now();
+    image_t padded = {.width = request.size.x,
+                      .height = request.size.y,
+                      .bands = 4,
+                      .data = malloc(request.size.x * request.size.y *
+                                     sizeof(uint32_t))};
+    if (!padded.data) {
+      err = 1;
+      break;
+    }
+    openslide_read_region(oslide.osr, padded.data, request.location.x,
+                          request.location.y, request.level, request.size.x,
+                          request.size.y);
+    double t2 = now();
+    allocs_t a2 = allocs_now();
+    if (openslide_get_error(oslide.osr)) {
+      err = 1;
+      free(padded.data);
+      break;
+    }
+    argb2rgba(padded.data, padded.width * padded.height);
+    double t3 = now();
+    allocs_t a3 = allocs_now();
+    dpos_t bottom_right = clip2size_d(
+        _addv(request.native.fractional_coordinates,
+              request.native.native_size),
+        (dpos_t){.x = padded.width, .y = padded.height});
+    dbox_t box = {.x1 = request.native.fractional_coordinates.x,
+                  .y1 = request.native.fractional_coordinates.y,
+                  .x2 = bottom_right.x,
+                  .y2 = bottom_right.y};
+    err |= image_resample(&region, &padded, box, IMAGING_TRANSFORM_LANCZOS);
+    double t4 = now();
+    allocs_t a4 = allocs_now();
+    free(padded.data);
+
+    stages[REQUEST].seconds[i] = t1 - t0;
+    stages[RAW_READ].seconds[i] = t2 - t1;
+    stages[ARGB2RGBA].seconds[i] = t3 - t2;
+    stages[RESAMPLE].seconds[i] = t4 - t3;
+    add_allocs(&stages[REQUEST], a0, a1);
+    add_allocs(&stages[RAW_READ], a1, a2);
+    add_allocs(&stages[ARGB2RGBA], a2, a3);
+    add_allocs(&stages[RESAMPLE], a3, a4);
+  }
+
+  // Same tiles, through oslide_read_region ( fused conversion, buffers from
+  // the slide's arena, no cache set )
+  for (int64_t i = 0; (i < n) & !err; i++) {
+    allocs_t a0 = allocs_now();
+    double t0 = now();
+    err |= oslide_read_region(&oslide, &region, records[i].request);
+    stages[READ_REGION].seconds[i] = now() - t0;
+    add_allocs(&stages[READ_REGION], a0, allocs_now());
+  }
+  if (err) {
+    const char *error = openslide_get_error(oslide.osr);
+    fprintf(stderr, "can't read tiles: %s\n", error ? error : "no memory");
+    return 1;
+  }
+
+  printf("{\n  \"slide\": \"%s\",\n  \"slide_size\": %d,\n  \"tile_size\": "
+         "%d,\n  \"scaling\": %f,\n  \"tiles\": %" PRId64
+         ",\n  \"stages\": {\n",
+         path, slide_size, tile_size, scaling, n);
+  for (int s = 0; s < STAGES; s++) {
+    print_stage(&stages[s], stage_names[s], n, s == STAGES - 1);
+    free(stages[s].seconds);
+  }
+  printf("  }\n}\n");
+
+  free(region.data);
+  free(records);
+  oslide_close(&oslide);
+  return 0;
+}
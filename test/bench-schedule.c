@@ -0,0 +1,109 @@
+// Locality scheduler vs round-robin, reading the requests of requests.csv
+// usage: bench-schedule <slide> <requests.csv> [threads] [cache MB]
+#include "slide.h"
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Requests as dumped by print_request_row, after a print_lss_row, and the
+// output size of each
+// NOTE: Remember to free
+static request_t *read_requests_csv(char *path, ipos_t **sizes,
+                                    int64_t *n_requests) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    return NULL;
+  }
+  int64_t capacity = 1024, n = 0;
+  request_t *requests = malloc(capacity * sizeof(request_t));
+  *sizes = malloc(capacity * sizeof(ipos_t));
+
+  ipos_t location, size;
+  double scaling;
+  request_t request;
+  fscanf(fp, "%*[^\n]\n"); // header
+  while (fscanf(fp, "%ld,%ld,%lf,%ld,%ld,%ld,%ld,%d,%ld,%ld,%lf,%lf,%lf,%lf\n",
+                &location.x, &location.y, &scaling, &size.x, &size.y,
+                &request.location.x, &request.location.y, &request.level,
+                &request.size.x, &request.size.y,
+                &request.native.fractional_coordinates.x,
+                &request.native.fractional_coordinates.y,
+                &request.native.native_size.x,
+                &request.native.native_size.y) == 14) {
+    if (n == capacity) {
+      capacity *= 2;
+      requests = realloc(requests, capacity * sizeof(request_t));
+      *sizes = realloc(*sizes, capacity * sizeof(ipos_t));
+    }
+    (*sizes)[n] = size;
+    requests[n++] = request;
+  }
+  fclose(fp);
+  *n_requests = n;
+  return requests;
+}
+
+static void bench(char *path, request_t *requests, image_t *regions,
+                  int64_t n, int n_threads, size_t cache_bytes,
+                  schedule_policy_t policy, const char *name) {
+  // Fresh handles, so no policy benefits from the previous one's caches
+  oslide_t oslide = oslide_open(path);
+  oslide_open_handles(&oslide, n_threads);
+  oslide_set_cache(&oslide, cache_bytes);
+  schedule_t *schedule = schedule_new(requests, n, n_threads, policy,
+                                      oslide.osr, oslide.level_props);
+
+  double start = now();
+  int64_t failed = read_regions_scheduled(&oslide, requests, regions, schedule);
+  double elapsed = now() - start;
+
+  tile_cache_stats_t stats = oslide_cache_stats(&oslide);
+  printf("%-12s: %ld tiles, %ld failed, %.3f s, %.1f tiles/s, %ld groups, "
+         "%ld steals, %ld blocks decoded\n",
+         name, n, failed, elapsed, n / elapsed, schedule->n_groups,
+         schedule->steals, stats.misses);
+
+  schedule_free(schedule);
+  oslide_close(&oslide);
+}
+
+int main(int argc, char **argv) {
+  if ((argc < 3) || !argv[1][0]) {
+    printf("usage: %s <slide> <requests.csv> [threads] [cache MB]\n", argv[0]);
+    return 77; // skipped
+  }
+  int n_threads = argc > 3 ? atoi(argv[3]) : 4;
+  size_t cache_bytes = argc > 4 ? (size_t)atol(argv[4]) << 20 : 0;
+
+  int64_t n;
+  ipos_t *sizes;
+  request_t *requests = read_requests_csv(argv[2], &sizes, &n);
+  if (!requests) {
+    printf("can't read %s\n", argv[2]);
+    return 1;
+  }
+  image_t *regions = malloc(n * sizeof(image_t));
+  for (int64_t i = 0; i < n; i++) {
+    ipos_t size = sizes[i];
+    regions[i] = (image_t){.width = size.x, .height = size.y, .bands = 4};
+    regions[i].data = malloc(size.x * size.y * sizeof(uint32_t));
+  }
+
+  printf("threads: %d, cache: %zu MB\n", n_threads, cache_bytes >> 20);
+  bench(argv[1], requests, regions, n, n_threads, cache_bytes,
+        SCHEDULE_ROUND_ROBIN, "round-robin");
+  bench(argv[1], requests, regions, n, n_threads, cache_bytes,
+        SCHEDULE_LOCALITY, "locality");
+
+  for (int64_t i = 0; i < n; i++) {
+    free(regions[i].data);
+  }
+  free(regions);
+  free(requests);
+  free(sizes);
+  return 0;
+}
@@ -0,0 +1,20 @@
+// CMU-1.svs' level geometry, for tests that need a real slide's levels but
+// not the slide itself
+#pragma once
+
+#include "types.h"
+
+#define CMU1_LEVEL_COUNT 3
+
+static ipos_t cmu1_dimensions[CMU1_LEVEL_COUNT] = {
+    {46000, 32914}, {11500, 8228}, {2875, 2057}};
+static double cmu1_downsamples[CMU1_LEVEL_COUNT] = {1.0, 4.000121536217793,
+                                                    16.00048614487193};
+
+static inline level_props_t cmu1_level_props(void) {
+  level_props_t level_props = {.slide_size = cmu1_dimensions[0],
+                               .level_count = CMU1_LEVEL_COUNT,
+                               .level_dimensions = cmu1_dimensions,
+                               .level_downsamples = cmu1_downsamples};
+  return level_props;
+}
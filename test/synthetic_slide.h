@@ -0,0 +1,84 @@
+// Synthetic slides for tests and benchmarks: noise RGB at SYNTHETIC_MPP,
+// tiled, pyramidal, JPEG TIFF, which openslide reads as generic-tiff.
+// Levels halve the size, so a power of 2 size gives integral downsamples,
+// an odd one non integral ones.
+// NOTE: Call VIPS_INIT first
+#pragma once
+
+#include "slide.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vips/vips.h>
+
+#define SYNTHETIC_MPP 0.25
+
+static int synthetic_slide_write(const char *path, int size) {
+  VipsImage *bands[3], *rgb, *uchar, *out;
+  double means[3] = {200.0, 120.0, 180.0};
+  for (int i = 0; i < 3; i++) {
+    if (vips_gaussnoise(&bands[i], size, size, "mean", means[i], "sigma",
+                        30.0, NULL)) {
+      return 1;
+    }
+  }
+  int err = vips_bandjoin(bands, &rgb, 3, NULL);
+  for (int i = 0; i < 3; i++) {
+    g_object_unref(bands[i]);
+  }
+  if (err) {
+    return 1;
+  }
+  err = vips_cast_uchar(rgb, &uchar, NULL);
+  g_object_unref(rgb);
+  if (err) {
+    return 1;
+  }
+  // vips resolution is in pixels per mm
+  err = vips_copy(uchar, &out, "interpretation", VIPS_INTERPRETATION_sRGB,
+                  "xres", 1000.0 / SYNTHETIC_MPP, "yres",
+                  1000.0 / SYNTHETIC_MPP, NULL);
+  g_object_unref(uchar);
+  if (err) {
+    return 1;
+  }
+  err = vips_tiffsave(out, path, "tile", TRUE, "tile_width", 256,
+                      "tile_height", 256, "pyramid", TRUE, "compression",
+                      VIPS_FOREIGN_TIFF_COMPRESSION_JPEG, "Q", 90, "resunit",
+                      VIPS_FOREIGN_TIFF_RESUNIT_CM, NULL);
+  g_object_unref(out);
+  return err;
+}
+
+// <dir>/synthetic-<size>.tiff into path, generated on the first use. Written
+// under a temporary name then renamed, as tests may run in parallel.
+static int synthetic_slide_path(char *path, size_t len, const char *dir,
+                                int size) {
+  snprintf(path, len, "%s/synthetic-%d.tiff", dir, size);
+  struct stat st;
+  if (!stat(path, &st)) {
+    return 0;
+  }
+  char tmp_path[4096 + 32];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+  if (synthetic_slide_write(tmp_path, size) || rename(tmp_path, path)) {
+    fprintf(stderr, "can't make %s: %s\n", path, vips_error_buffer());
+    remove(tmp_path);
+    return 1;
+  }
+  return 0;
+}
+
+// Open the synthetic slide of size, generating it in dir if needed
+// NOTE: oslide keeps path ( e.g. for oslide_open_handles ), keep it around
+static int synthetic_slide_open(oslide_t *oslide, char *path, size_t len,
+                                const char *dir, int size) {
+  if (synthetic_slide_path(path, len, dir, size)) {
+    return 1;
+  }
+  *oslide = oslide_open(path);
+  if (!oslide->osr || openslide_get_error(oslide->osr)) {
+    fprintf(stderr, "can't open %s\n", path);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+// Arenas: grow only block pools settle where the default arena reallocates,
+// and once warm, reads of the same requests make no new allocations,
+// sequential or parallel.
+// usage: test-arenas <dir>, synthetic slides are generated in <dir>
+#include "resize.h"
+#include "synthetic_slide.h"
+#include <inttypes.h>
+
+#define TILE_SIZE 128
+#define THREADS 4
+
+// Size of the block served for small after one of big was returned
+static int pooled_size(ImagingMemoryArena arena, int big, int small) {
+  ImagingMemoryBlock block = ImagingMemoryGetBlock(arena, big, 1);
+  ImagingMemoryReturnBlock(arena, block);
+  block = ImagingMemoryGetBlock(arena, small, 1);
+  ImagingMemoryReturnBlock(arena, block);
+  return block.size;
+}
+
+static int check_pools(void) {
+  struct ImagingMemoryArena arena;
+  ImagingMemoryArenaInit(&arena, 1);
+  int grow_only = pooled_size(&arena, 3 << 20, 1 << 20);
+  // Over block_size ( 16MB ): pooled whole, not shrunk on return
+  int big = arena.block_size + (8 << 20);
+  int large = pooled_size(&arena, big, big);
+  int large_pooled = arena.blocks_pool[0].size;
+  int allocated = arena.stats_allocated_blocks;
+  ImagingMemoryArenaRelease(&arena);
+
+  // Pillow's behaviour: blocks are reallocated to every size requested
+  ImagingMemorySetBlocksMax(&ImagingDefaultArena, 1);
+  int exact = pooled_size(&ImagingDefaultArena, 3 << 20, 1 << 20);
+  ImagingMemorySetBlocksMax(&ImagingDefaultArena, 0);
+
+  printf("pools: %d bytes grow only, %d exact, %d large\n", grow_only,
+         exact, large_pooled);
+  return (grow_only != 3 << 20) | (allocated != 1) | (exact != 1 << 20) |
+         (large != big) | (large_pooled != big);
+}
+
+static void print_stats(const char *name, arena_stats_t stats) {
+  printf("%s: %" PRId64 " allocated, %" PRId64 " reused, %" PRId64
+         " reallocated\n",
+         name, stats.allocated_blocks, stats.reused_blocks,
+         stats.reallocated_blocks);
+}
+
+// Allocations of the second of two passes must not move
+static int check_flat(const char *name, arena_stats_t first,
+                      arena_stats_t second) {
+  print_stats(name, second);
+  return (second.allocated_blocks != first.allocated_blocks) |
+         (second.reallocated_blocks != first.reallocated_blocks) |
+         (second.reused_blocks <= first.reused_blocks);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <dir>\n", argv[0]);
+    return 1;
+  }
+  if (VIPS_INIT(argv[0])) {
+    return 1;
+  }
+  int failures = check_pools();
+
+  char path[4096];
+  oslide_t oslide;
+  if (synthetic_slide_open(&oslide, path, sizeof(path), argv[1], 4096)) {
+    return 1;
+  }
+  // Fractional locations, so padded sizes vary by a pixel or two
+  tiling_t tiling = {.scaling = 0.2495,
+                     .tile_size = {TILE_SIZE, TILE_SIZE},
+                     .roi_size = {1000, 1000}};
+  int64_t n;
+  request_t *requests =
+      read_region_requests(tiling, oslide.osr, oslide.level_props, &n);
+  if (!requests || !n) {
+    return 1;
+  }
+  image_t *regions = calloc(n, sizeof(image_t));
+  for (int64_t i = 0; i < n; i++) {
+    regions[i] = (image_t){.width = TILE_SIZE,
+                           .height = TILE_SIZE,
+                           .bands = 4,
+                           .data = malloc(TILE_SIZE * TILE_SIZE * 4)};
+  }
+
+  // Sequential, arena 0
+  arena_stats_t stats[2];
+  for (int pass = 0; pass < 2; pass++) {
+    for (int64_t i = 0; i < n; i++) {
+      failures += oslide_read_region(&oslide, &regions[i], requests[i]);
+    }
+    stats[pass] = oslide_arena_stats(&oslide);
+  }
+  print_stats("sequential, first", stats[0]);
+  failures += check_flat("sequential, second", stats[0], stats[1]);
+
+  // Parallel, an arena per worker. Round robin, so each worker's arena sees
+  // the same requests both times ( stealing would hand a worker larger
+  // tiles than it has seen, a legitimate growth )
+  for (int pass = 0; pass < 2; pass++) {
+    schedule_t *schedule =
+        schedule_new(requests, n, THREADS, SCHEDULE_ROUND_ROBIN, oslide.osr,
+                     oslide.level_props);
+    failures += read_regions_scheduled(&oslide, requests, regions, schedule);
+    schedule_free(schedule);
+    stats[pass] = oslide_arena_stats(&oslide);
+  }
+  print_stats("parallel, first", stats[0]);
+  failures += check_flat("parallel, second", stats[0], stats[1]);
+
+  for (int64_t i = 0; i < n; i++) {
+    free(regions[i].data);
+  }
+  free(regions);
+  free(requests);
+  oslide_close(&oslide);
+  printf("%d failures\n", failures);
+  return failures > 0;
+}
@@ -0,0 +1,76 @@
+// argb2rgba must match argb2rgba_scalar for every alpha / colour, at every
+// level the cpu supports ( scalar, SSSE3, AVX2 ).
+// rgba2rgb_over / rgba2planar_over must composite over the background.
+#include "ops.h"
+#include <math.h>
+#include <string.h>
+
+// Failures of argb2rgba at the current level
+static int check_argb2rgba(void) {
+  // Every ( alpha, colour ) pair, colours rotated so channels differ
+  int len = 256 * 256;
+  uint32_t *expected = malloc(len * sizeof(uint32_t));
+  uint32_t *actual = malloc(len * sizeof(uint32_t));
+  for (int a = 0; a < 256; a++) {
+    for (int c = 0; c < 256; c++) {
+      uint32_t val = a << 24 | c << 16 | ((c * 7) & 0xff) << 8 | (255 - c);
+      expected[a * 256 + c] = actual[a * 256 + c] = val;
+    }
+  }
+  argb2rgba_scalar(expected, len);
+  argb2rgba(actual, len);
+  int failures = memcmp(expected, actual, len * sizeof(uint32_t)) != 0;
+
+  // Fully opaque tile, plus a tail that is not a multiple of the vector size
+  len = 256 * 256 + 5;
+  expected = realloc(expected, len * sizeof(uint32_t));
+  actual = realloc(actual, len * sizeof(uint32_t));
+  for (int i = 0; i < len; i++) {
+    expected[i] = actual[i] = 0xff000000 | (i * 2654435761u >> 8);
+  }
+  argb2rgba_scalar(expected, len);
+  argb2rgba(actual, len);
+  failures += memcmp(expected, actual, len * sizeof(uint32_t)) != 0;
+
+  free(expected);
+  free(actual);
+  return failures;
+}
+
+int main(void) {
+  int failures = 0;
+  for (int level = 0; level <= 2; level++) {
+    if (argb2rgba_set_level(level) != level) {
+      printf("argb2rgba level %d: not supported, skipped\n", level);
+      continue;
+    }
+    int level_failures = check_argb2rgba();
+    printf("argb2rgba level %d: %d failures\n", level, level_failures);
+    failures += level_failures;
+  }
+  argb2rgba_set_level(2);
+
+  // Every premultiplied ( alpha, colour <= alpha ), packed and planar
+  uint32_t background = 0xf0e0d0;
+  int bg[3] = {0xf0, 0xe0, 0xd0};
+  uint8_t rgba[256 * 4], rgb[256 * 3], planes[3][256];
+  for (int a = 0; a < 256; a++) {
+    for (int c = 0; c < 256; c++) {
+      int cc = c <= a ? c : a;
+      rgba[c * 4 + 0] = cc;
+      rgba[c * 4 + 1] = cc / 2;
+      rgba[c * 4 + 2] = a - cc;
+      rgba[c * 4 + 3] = a;
+    }
+    rgba2rgb_over(rgb, rgba, 256, background);
+    rgba2planar_over(planes[0], planes[1], planes[2], rgba, 256, background);
+    for (int i = 0; i < 256 * 3; i++) {
+      double over = rgba[i / 3 * 4 + i % 3] + bg[i % 3] * (255 - a) / 255.0;
+      failures += fabs(rgb[i] - over) > 0.5;
+      failures += rgb[i] != planes[i % 3][i / 3];
+    }
+  }
+
+  printf("failures: %d\n", failures);
+  return failures != 0;
+}
@@ -0,0 +1,106 @@
+// Background requests: is_background_request at the openslide.bounds-*
+// edges, touching ( background ) and one pixel inside ( read ), and
+// fill_background in every format, tails included.
+#include "slide.h"
+#include <inttypes.h>
+
+static int check_request(const char *name, ipos_t location, int level,
+                         int expected, slide_props_t slide_props,
+                         level_props_t level_props) {
+  request_t request = {.location = location, .level = level, .size = {64, 64}};
+  int background = is_background_request(request, slide_props, level_props);
+  if (background != expected) {
+    fprintf(stderr, "%s ( %" PRId64 ", %" PRId64 " ): background %d\n", name,
+            location.x, location.y, background);
+    return 1;
+  }
+  return 0;
+}
+
+// Every pixel r, g, b ( and opaque ) in region's format
+static int check_fill(image_format_t format, int width, int height) {
+  uint8_t r = 0x12, g = 0x34, b = 0x56;
+  int64_t pixels = (int64_t)width * height;
+  image_t region = {.width = width,
+                    .height = height,
+                    .bands = format == IMAGE_RGBA ? 4 : 3,
+                    .format = format,
+                    .data = calloc(pixels, sizeof(uint32_t))};
+  fill_background(&region, (uint32_t)r << 16 | (uint32_t)g << 8 | b);
+
+  uint8_t *bytes = (uint8_t *)region.data;
+  int failures = 0;
+  for (int64_t i = 0; i < pixels; i++) {
+    switch (format) {
+    case IMAGE_RGBA:
+      failures += (bytes[i * 4 + 0] != r) | (bytes[i * 4 + 1] != g) |
+                  (bytes[i * 4 + 2] != b) | (bytes[i * 4 + 3] != 0xff);
+      break;
+    case IMAGE_RGB:
+      failures += (bytes[i * 3 + 0] != r) | (bytes[i * 3 + 1] != g) |
+                  (bytes[i * 3 + 2] != b);
+      break;
+    case IMAGE_CHW:
+      failures += (bytes[i] != r) | (bytes[pixels + i] != g) |
+                  (bytes[2 * pixels + i] != b);
+      break;
+    }
+  }
+  // Nothing written past the region
+  for (int64_t i = pixels * region.bands; i < pixels * 4; i++) {
+    failures += bytes[i] != 0;
+  }
+  if (failures) {
+    fprintf(stderr, "format %d, %dx%d: %d wrong bytes\n", format, width,
+            height, failures);
+  }
+  free(region.data);
+  return failures;
+}
+
+int main(void) {
+  // Bounds 4000x3000 at 1000, 2000
+  slide_props_t slide_props = {.offset = {1000, 2000}, .bounds = {4000, 3000}};
+  ipos_t dimensions[2] = {{8000, 8000}, {2000, 2000}};
+  double downsamples[2] = {1.0, 4.0};
+  level_props_t level_props = {.level_count = 2,
+                               .slide_size = {8000, 8000},
+                               .level_dimensions = dimensions,
+                               .level_downsamples = downsamples};
+  int failures = 0;
+
+  // 64 native pixels: 64 level 0 pixels at level 0, 256 at level 1
+  for (int level = 0; level < 2; level++) {
+    int64_t extent = 64 * (int64_t)downsamples[level];
+    struct {
+      const char *name;
+      ipos_t location;
+      int expected;
+    } cases[9] = {
+        {"left, touching", {1000 - extent, 3000}, 1},
+        {"left, inside", {1000 - extent + 1, 3000}, 0},
+        {"top, touching", {2000, 2000 - extent}, 1},
+        {"top, inside", {2000, 2000 - extent + 1}, 0},
+        {"right, touching", {5000, 3000}, 1},
+        {"right, inside", {4999, 3000}, 0},
+        {"bottom, touching", {2000, 5000}, 1},
+        {"bottom, inside", {2000, 4999}, 0},
+        {"corner, touching", {5000, 2000 - extent}, 1},
+    };
+    for (int i = 0; i < 9; i++) {
+      failures += check_request(cases[i].name, cases[i].location, level,
+                                cases[i].expected, slide_props, level_props);
+    }
+  }
+
+  // Whole 16 pixel blocks, tails, and less than a block
+  int sizes[4][2] = {{16, 4}, {37, 5}, {7, 1}, {1, 1}};
+  for (int i = 0; i < 4; i++) {
+    failures += check_fill(IMAGE_RGBA, sizes[i][0], sizes[i][1]);
+    failures += check_fill(IMAGE_RGB, sizes[i][0], sizes[i][1]);
+    failures += check_fill(IMAGE_CHW, sizes[i][0], sizes[i][1]);
+  }
+
+  printf("%d failures\n", failures);
+  return failures > 0;
+}
@@ -0,0 +1,93 @@
+// Export round trip: a synthetic slide exported at a scaling, reopened, has
+// the scaled size and, region for region, the pixels read_region gives up
+// to JPEG loss. vips' concurrency is left as it was.
+// usage: test-export <dir>, synthetic slides are generated in <dir>
+#include "export.h"
+#include "synthetic_slide.h"
+#include <inttypes.h>
+
+#define REGION_SIZE 256
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <dir>\n", argv[0]);
+    return 1;
+  }
+  if (VIPS_INIT(argv[0])) {
+    return 1;
+  }
+  char path[4096];
+  oslide_t oslide;
+  if (synthetic_slide_open(&oslide, path, sizeof(path), argv[1], 2048)) {
+    return 1;
+  }
+  int failures = 0;
+
+  // Near lossless, on 2 threads
+  double scaling = 0.4;
+  char export_path[4096 + 32];
+  snprintf(export_path, sizeof(export_path), "%s/export-%d.tiff", argv[1],
+           (int)getpid());
+  export_options_t options = {.quality = 100, .threads = 2};
+  int concurrency = vips_concurrency_get();
+  if (oslide_export_tiff(&oslide, scaling, export_path, options)) {
+    fprintf(stderr, "can't export %s: %s\n", export_path, vips_error_buffer());
+    return 1;
+  }
+  failures += vips_concurrency_get() != concurrency;
+
+  oslide_t exported = oslide_open(export_path);
+  const char *error = exported.osr ? openslide_get_error(exported.osr)
+                                    : "not a slide";
+  if (error) {
+    fprintf(stderr, "can't open %s: %s\n", export_path, error);
+    return 1;
+  }
+  ipos_t scaled_size = get_scaled_size(oslide.level_props.slide_size, scaling);
+  ipos_t exported_size = exported.level_props.level_dimensions[0];
+  failures += (exported_size.x != scaled_size.x) |
+              (exported_size.y != scaled_size.y);
+
+  // Straddling export tiles and vimage chunks
+  ipos_t location = {.x = 200, .y = 300};
+  ipos_t size = {.x = REGION_SIZE, .y = REGION_SIZE};
+  image_t expected = {.width = size.x,
+                      .height = size.y,
+                      .bands = 4,
+                      .data = malloc(size.x * size.y * sizeof(uint32_t))};
+  uint32_t *actual = malloc(size.x * size.y * sizeof(uint32_t));
+  request_t request = read_region_request(location, scaling, size, oslide.osr,
+                                          oslide.level_props);
+  failures += read_region(&expected, oslide.osr, request);
+  openslide_read_region(exported.osr, actual, location.x, location.y, 0,
+                        size.x, size.y);
+  if ((error = openslide_get_error(exported.osr))) {
+    fprintf(stderr, "can't read %s: %s\n", export_path, error);
+    return 1;
+  }
+  argb2rgba(actual, size.x * size.y);
+
+  // Opaque slide: colour bands only
+  uint8_t *e = (uint8_t *)expected.data, *a = (uint8_t *)actual;
+  double total = 0.0;
+  int max = 0;
+  for (int i = 0; i < size.x * size.y * 4; i++) {
+    if (i % 4 != 3) {
+      int d = abs(e[i] - a[i]);
+      total += d;
+      max = MAX(max, d);
+    }
+  }
+  double mean = total / (size.x * size.y * 3);
+  printf("export: %" PRId64 "x%" PRId64 ", mean error %.3f, max %d\n",
+         exported_size.x, exported_size.y, mean, max);
+  failures += mean > 2.0;
+
+  free(expected.data);
+  free(actual);
+  oslide_close(&exported);
+  oslide_close(&oslide);
+  remove(export_path);
+  printf("%d failures\n", failures);
+  return failures > 0;
+}
@@ -0,0 +1,79 @@
+// choose_level: the default bound picks openslide's level, a looser one
+// picks the coarser level just below a boundary, for less pixels read, a
+// stricter one a finer level than openslide's.
+#include "cmu1_slide.h"
+#include "slide.h"
+
+int main(void) {
+  level_props_t level_props = cmu1_level_props();
+  ipos_t size = {.x = 256, .y = 256};
+  level_policy_t policy = LEVEL_POLICY_DEFAULT;
+  int failures = 0;
+
+  // Same as openslide, everywhere from 2x up to 1/64x
+  for (double scaling = 2.0; scaling > 1.0 / 64; scaling *= 0.99) {
+    level_choice_t choice =
+        choose_level(scaling, size, &policy, NULL, level_props);
+    int expected = best_level_for_downsample(level_props, 1 / scaling);
+    if ((choice.level != expected) || (choice.level != choice.default_level)) {
+      fprintf(stderr, "scaling %f: level %d ( %s ), expected %d\n", scaling,
+              choice.level, level_reason_name(choice.reason), expected);
+      failures++;
+    }
+    failures += choice.reason !=
+                (scaling > 1.0 ? LEVEL_REASON_FINEST : LEVEL_REASON_CHEAPEST);
+  }
+
+  // Just below the level 1 boundary: openslide reads level 0
+  double scaling = 0.2501;
+  level_choice_t choice = choose_level(scaling, size, NULL, NULL, level_props);
+  failures += (choice.level != 0) | (choice.reason != LEVEL_REASON_DEFAULT);
+
+  // 5% upsampling allowed: level 1, at a fraction of the cost
+  policy.max_upsample = 1.05;
+  choice = choose_level(scaling, size, &policy, NULL, level_props);
+  printf("scaling %f: level %d ( %s ), cost %.0f vs %.0f at level %d\n",
+         scaling, choice.level, level_reason_name(choice.reason), choice.cost,
+         choice.default_cost, choice.default_level);
+  failures += (choice.level != 1) | (choice.reason != LEVEL_REASON_UPSAMPLE);
+  failures += choice.cost * 2 > choice.default_cost;
+
+  // Per batch: the tiling's policy decides every request's level
+  tiling_t tiling = {.scaling = scaling, .tile_size = size, .policy = &policy};
+  int64_t n;
+  request_t *requests = read_region_requests(tiling, NULL, level_props, &n);
+  if (!requests) {
+    return 1;
+  }
+  for (int64_t i = 0; i < n; i++) {
+    failures += requests[i].level != 1;
+  }
+  free(requests);
+  tiling.policy = NULL;
+  requests = read_region_requests(tiling, NULL, level_props, &n);
+  if (!requests) {
+    return 1;
+  }
+  failures += (n > 0) && (requests[0].level != 0);
+  free(requests);
+
+  // Stricter than openslide: 5x down would read level 1, a 0.7 bound
+  // needs level 0
+  policy.max_upsample = 0.7;
+  choice = choose_level(0.2, size, &policy, NULL, level_props);
+  failures += (choice.default_level != 1) | (choice.level != 0) |
+              (choice.reason != LEVEL_REASON_BOUND);
+  failures += choice.cost <= choice.default_cost;
+  // Loose enough for level 1 again: openslide's level, cheapest
+  policy.max_upsample = 0.9;
+  choice = choose_level(0.2, size, &policy, NULL, level_props);
+  failures += (choice.level != 1) | (choice.reason != LEVEL_REASON_CHEAPEST);
+  policy.max_upsample = 1.05;
+
+  // Upsampling everywhere: finest level
+  choice = choose_level(4.0, size, &policy, NULL, level_props);
+  failures += (choice.level != 0) | (choice.reason != LEVEL_REASON_FINEST);
+
+  printf("%d failures\n", failures);
+  return failures > 0;
+}
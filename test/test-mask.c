@@ -0,0 +1,137 @@
+// Tissue mask on a synthetic bimodal image: Otsu splits the saturation
+// modes, coverage is exact at the tissue and slide borders, and
+// tissue_mask_filter keeps requests in order.
+#include "mask.h"
+#include <inttypes.h>
+
+// 64x32 mask pixels, 100 level 0 pixels each
+#define WIDTH 64
+#define HEIGHT 32
+#define DOWNSAMPLE 100
+
+// Left half tissue ( saturation 91 to 127 ), right half background ( 5 to
+// 8 ), top left pixel transparent tissue
+static image_t bimodal_image(void) {
+  image_t image = {.width = WIDTH,
+                   .height = HEIGHT,
+                   .bands = 4,
+                   .format = IMAGE_RGBA,
+                   .data = malloc(WIDTH * HEIGHT * sizeof(uint32_t))};
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      uint32_t r = 240, g = 235 - y % 4, b = 238, a = 255;
+      if (x < WIDTH / 2) {
+        r = 200, g = 100 + (x % 8) * 4, b = 150;
+      }
+      a = (x == 0) & (y == 0) ? 0 : a;
+      image.data[y * WIDTH + x] = r | g << 8 | b << 16 | a << 24;
+    }
+  }
+  return image;
+}
+
+static int check_coverage(tissue_mask_t *mask, ipos_t location, ipos_t size,
+                          double expected) {
+  double coverage = tissue_mask_coverage(mask, location, size);
+  if (coverage != expected) {
+    fprintf(stderr,
+            "%" PRId64 "x%" PRId64 " at %" PRId64 ",%" PRId64
+            ": coverage %f, expected %f\n",
+            size.x, size.y, location.x, location.y, coverage, expected);
+    return 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  image_t image = bimodal_image();
+  ipos_t slide_size = {.x = WIDTH * DOWNSAMPLE, .y = HEIGHT * DOWNSAMPLE};
+  tissue_mask_t mask;
+  if (tissue_mask_from_image(&mask, &image, slide_size, -1)) {
+    return 1;
+  }
+  int failures = 0;
+
+  // Otsu: between the modes, so the halves split exactly
+  printf("otsu threshold %d\n", mask.threshold);
+  failures += (mask.threshold < 8) | (mask.threshold >= 91);
+  failures += (mask.downsample.x != DOWNSAMPLE) |
+              (mask.downsample.y != DOWNSAMPLE);
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      int tissue = (x < WIDTH / 2) & ((x != 0) | (y != 0));
+      failures += mask.data[y * WIDTH + x] != tissue;
+    }
+  }
+
+  // A given threshold is used as is
+  tissue_mask_t fixed;
+  if (tissue_mask_from_image(&fixed, &image, slide_size, 50)) {
+    return 1;
+  }
+  failures += fixed.threshold != 50;
+  failures += memcmp(fixed.data, mask.data, WIDTH * HEIGHT) != 0;
+  tissue_mask_free(&fixed);
+  free(image.data);
+
+  // Whole slide, transparent pixel, either side of the tissue border
+  ipos_t mask_pixel = {.x = DOWNSAMPLE, .y = DOWNSAMPLE};
+  failures += check_coverage(&mask, (ipos_t){0, 0}, slide_size,
+                             (WIDTH * HEIGHT / 2 - 1.0) / (WIDTH * HEIGHT));
+  failures += check_coverage(&mask, (ipos_t){0, 0}, mask_pixel, 0.0);
+  failures += check_coverage(&mask, (ipos_t){3100, 1000}, mask_pixel, 1.0);
+  failures += check_coverage(&mask, (ipos_t){3200, 1000}, mask_pixel, 0.0);
+  // One level 0 pixel over the border touches 2 mask pixels
+  failures += check_coverage(&mask, (ipos_t){3101, 1000}, mask_pixel, 0.5);
+
+  // Slide borders: last mask pixels, then half outside, then outside
+  failures += check_coverage(&mask, (ipos_t){0, 3100}, mask_pixel, 1.0);
+  failures += check_coverage(&mask, (ipos_t){6300, 3100}, mask_pixel, 0.0);
+  failures += check_coverage(&mask, (ipos_t){-100, 3100}, (ipos_t){200, 200},
+                             0.25);
+  failures += check_coverage(&mask, (ipos_t){-100, 1000}, (ipos_t){200, 100},
+                             0.5);
+  failures += check_coverage(&mask, (ipos_t){7000, 1000}, mask_pixel, 0.0);
+  failures += check_coverage(&mask, (ipos_t){100, 100}, (ipos_t){0, 0}, 0.0);
+
+  // Requests at level 0, 256 native pixels: coverage in mask pixels touched
+  double downsamples[1] = {1.0};
+  level_props_t level_props = {.level_count = 1,
+                               .slide_size = slide_size,
+                               .level_dimensions = &slide_size,
+                               .level_downsamples = downsamples};
+  ipos_t locations[6] = {
+      {0, 1000},    // tissue, 1
+      {3200, 1000}, // background, 0
+      {3000, 1000}, // 2 of 3 tissue columns
+      {3100, 1000}, // 1 of 3
+      {-128, 1000}, // 2 of 4, half outside
+      {0, 3100},    // 1 of 3 rows, past the bottom
+  };
+  request_t requests[6];
+  for (int i = 0; i < 6; i++) {
+    requests[i] = (request_t){
+        .location = locations[i],
+        .level = 0,
+        .size = {256, 256},
+        .native = {.fractional_coordinates = {0, 0},
+                   .native_size = {256, 256}}};
+  }
+  failures += tissue_mask_request_coverage(&mask, requests[4], level_props) !=
+              0.5;
+
+  // Kept in order, compacted to the front
+  int64_t kept = tissue_mask_filter(&mask, requests, 6, level_props, 0.5);
+  printf("kept %" PRId64 " of 6\n", kept);
+  int expected[3] = {0, 2, 4};
+  failures += kept != 3;
+  for (int64_t i = 0; i < MIN(kept, 3); i++) {
+    failures += (requests[i].location.x != locations[expected[i]].x) |
+                (requests[i].location.y != locations[expected[i]].y);
+  }
+  failures += tissue_mask_filter(&mask, requests, kept, level_props, 1.01) != 0;
+
+  tissue_mask_free(&mask);
+  printf("%d failures\n", failures);
+  return failures > 0;
+}
@@ -0,0 +1,94 @@
+// RGB and CHW reads: read_region, the cached read and read_region_streamed
+// give 3 bands, equal to the RGBA read composited over the background.
+// usage: test-read-formats <dir>, synthetic slides are generated in <dir>
+#include "synthetic_slide.h"
+
+#define BACKGROUND 0x3080c0
+
+enum { READ_REGION, CACHED, STREAMED, READS };
+static const char *read_names[READS] = {"read_region", "cached", "streamed"};
+
+static int read_with(int read, oslide_t *oslide, image_t *region,
+                     request_t request) {
+  switch (read) {
+  case CACHED:
+    return oslide_read_region(oslide, region, request);
+  case STREAMED:
+    return read_region_streamed(region, oslide->osr, request, 7);
+  default:
+    return read_region(region, oslide->osr, request);
+  }
+}
+
+// Largest difference of actual, in its format, from straight RGBA expected
+// composited over BACKGROUND
+static double max_difference(image_t *expected, image_t *actual) {
+  int64_t pixels = (int64_t)actual->width * actual->height;
+  uint8_t *e = (uint8_t *)expected->data, *a = (uint8_t *)actual->data;
+  int bg[3] = {BACKGROUND >> 16 & 0xff, BACKGROUND >> 8 & 0xff,
+               BACKGROUND & 0xff};
+  double max = 0.0;
+  for (int64_t i = 0; i < pixels; i++) {
+    double alpha = e[i * 4 + 3] / 255.0;
+    for (int c = 0; c < 3; c++) {
+      double over = e[i * 4 + c] * alpha + bg[c] * (1 - alpha);
+      int value = actual->format == IMAGE_CHW ? a[c * pixels + i]
+                                              : a[i * 3 + c];
+      max = MAX(max, fabs(value - over));
+    }
+  }
+  return max;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <dir>\n", argv[0]);
+    return 1;
+  }
+  if (VIPS_INIT(argv[0])) {
+    return 1;
+  }
+  char path[4096];
+  oslide_t oslide;
+  if (synthetic_slide_open(&oslide, path, sizeof(path), argv[1], 4096)) {
+    return 1;
+  }
+  // Integral downsample, so the cached and streamed reads use their blocks
+  // and strips rather than falling back to read_region
+  oslide_set_cache(&oslide, 64 << 20);
+  ipos_t location = {.x = 117, .y = 213}, size = {.x = 300, .y = 200};
+  request_t request = read_region_request(location, 0.5, size, oslide.osr,
+                                          oslide.level_props);
+  image_t expected = {.width = size.x,
+                      .height = size.y,
+                      .bands = 4,
+                      .data = malloc(size.x * size.y * sizeof(uint32_t))};
+  int failures = read_region(&expected, oslide.osr, request);
+
+  image_format_t formats[2] = {IMAGE_RGB, IMAGE_CHW};
+  for (int f = 0; f < 2; f++) {
+    for (int r = 0; r < READS; r++) {
+      // Bands set wrong on purpose, reads set them
+      image_t actual = {.width = size.x,
+                        .height = size.y,
+                        .bands = 4,
+                        .format = formats[f],
+                        .background = BACKGROUND,
+                        .data = malloc(size.x * size.y * 3)};
+      failures += read_with(r, &oslide, &actual, request);
+      // Both sides rounded once
+      double max = max_difference(&expected, &actual);
+      printf("%s, %s: max difference %.2f\n", read_names[r],
+             formats[f] == IMAGE_RGB ? "rgb" : "chw", max);
+      failures += (actual.bands != 3) | (max > 1.0);
+      free(actual.data);
+    }
+  }
+
+  failures += oslide_cache_stats(&oslide).misses == 0;
+
+  free(expected.data);
+  oslide_close(&oslide);
+  printf("%d failures\n", failures);
+  return failures > 0;
+}
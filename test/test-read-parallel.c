@@ -0,0 +1,101 @@
+// Parallel and scheduled batch reads give the same regions as a sequential
+// oslide_read_region loop, byte for byte: one thread, several threads on a
+// handle pool, with the tile cache shared between them, and scheduled.
+// usage: test-read-parallel <dir>, synthetic slides are generated in <dir>
+#include "synthetic_slide.h"
+
+#define TILE_SIZE 128
+#define THREADS 4
+
+static image_t *new_regions(int64_t n) {
+  image_t *regions = calloc(n, sizeof(image_t));
+  for (int64_t i = 0; i < n; i++) {
+    regions[i] = (image_t){.width = TILE_SIZE,
+                           .height = TILE_SIZE,
+                           .bands = 4,
+                           .data = calloc(TILE_SIZE * TILE_SIZE, 4)};
+  }
+  return regions;
+}
+
+static void free_regions(image_t *regions, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    free(regions[i].data);
+  }
+  free(regions);
+}
+
+// Regions that differ from expected, cleared for the next run
+static int compare_tiles(const char *name, image_t *expected, image_t *actual,
+                         int64_t n) {
+  int differ = 0;
+  for (int64_t i = 0; i < n; i++) {
+    differ += memcmp(expected[i].data, actual[i].data,
+                     TILE_SIZE * TILE_SIZE * 4) != 0;
+    memset(actual[i].data, 0, TILE_SIZE * TILE_SIZE * 4);
+  }
+  printf("%s: %d differ\n", name, differ);
+  return differ;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <dir>\n", argv[0]);
+    return 1;
+  }
+  if (VIPS_INIT(argv[0])) {
+    return 1;
+  }
+  char path[4096];
+  oslide_t oslide;
+  if (synthetic_slide_open(&oslide, path, sizeof(path), argv[1], 4096)) {
+    return 1;
+  }
+
+  // Overlapping tiles, so workers share cache blocks
+  tiling_t tiling = {.scaling = 0.5,
+                     .tile_size = {TILE_SIZE, TILE_SIZE},
+                     .overlap = {TILE_SIZE / 4, TILE_SIZE / 4},
+                     .roi_size = {1536, 1536}};
+  int64_t n;
+  request_t *requests =
+      read_region_requests(tiling, oslide.osr, oslide.level_props, &n);
+  if (!requests || !n) {
+    return 1;
+  }
+  image_t *expected = new_regions(n), *actual = new_regions(n);
+  int failures = 0;
+  for (int64_t i = 0; i < n; i++) {
+    failures += oslide_read_region(&oslide, &expected[i], requests[i]);
+  }
+
+  failures += read_regions_parallel(&oslide, requests, actual, n, 1);
+  failures += compare_tiles("1 thread", expected, actual, n);
+
+  if (oslide_open_handles(&oslide, THREADS)) {
+    return 1;
+  }
+  failures += read_regions_parallel(&oslide, requests, actual, n, THREADS);
+  failures += compare_tiles("handles", expected, actual, n);
+
+  // More threads than handles, and a cache small enough to evict pinned
+  // neighbours' blocks
+  oslide_set_cache(&oslide, 8 * TILE_CACHE_BLOCK_SIZE *
+                                TILE_CACHE_BLOCK_SIZE * sizeof(uint32_t));
+  failures +=
+      read_regions_parallel(&oslide, requests, actual, n, 2 * THREADS);
+  failures += compare_tiles("cached", expected, actual, n);
+
+  schedule_t *schedule = schedule_new(requests, n, THREADS, SCHEDULE_LOCALITY,
+                                      oslide.osr, oslide.level_props);
+  failures += read_regions_scheduled(&oslide, requests, actual, schedule);
+  failures += compare_tiles("scheduled", expected, actual, n);
+  schedule_free(schedule);
+
+  free_regions(expected, n);
+  free_regions(actual, n);
+  free(requests);
+  oslide_close(&oslide);
+  printf("%d failures\n", failures);
+  return failures > 0;
+}
@@ -0,0 +1,54 @@
+// read_region_streamed gives the same pixels as read_region, on integral
+// levels ( strips ) and non integral ones ( read_region itself ), for any
+// strip height.
+// usage: test-read-streamed <dir>, synthetic slides are generated in <dir>
+#include "synthetic_slide.h"
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <dir>\n", argv[0]);
+    return 1;
+  }
+  if (VIPS_INIT(argv[0])) {
+    return 1;
+  }
+  int sizes[2] = {4096, 3001};
+  double scalings[3] = {1.0, 0.5, 0.2495};
+  int strip_rows[3] = {1, 7, 4096};
+  ipos_t location = {.x = 117, .y = 213}, size = {.x = 300, .y = 200};
+  size_t bytes = size.x * size.y * sizeof(uint32_t);
+  char path[4096];
+  int failures = 0;
+
+  for (int i = 0; i < 2; i++) {
+    oslide_t oslide;
+    if (synthetic_slide_open(&oslide, path, sizeof(path), argv[1],
+                             sizes[i])) {
+      return 1;
+    }
+    image_t expected = {.width = size.x, .height = size.y, .bands = 4};
+    image_t actual = expected;
+    expected.data = malloc(bytes);
+    actual.data = malloc(bytes);
+    for (int s = 0; s < 3; s++) {
+      request_t request = read_region_request(
+          location, scalings[s], size, oslide.osr, oslide.level_props);
+      failures += read_region(&expected, oslide.osr, request);
+      for (int r = 0; r < 3; r++) {
+        int err = read_region_streamed(&actual, oslide.osr, request,
+                                       strip_rows[r]);
+        if (err || memcmp(expected.data, actual.data, bytes)) {
+          fprintf(stderr, "%d: scaling %f, level %d, %d rows: differ\n",
+                  sizes[i], scalings[s], request.level, strip_rows[r]);
+          failures++;
+        }
+      }
+    }
+    free(expected.data);
+    free(actual.data);
+    oslide_close(&oslide);
+  }
+
+  printf("%d failures\n", failures);
+  return failures > 0;
+}
@@ -0,0 +1,98 @@
+// native_region_requests_soa ( SIMD ) must match native_region_request bit
+// for bit, on CMU-1.svs' levels at a few scalings, and request_batch_tiling
+// must match read_region_requests.
+#include "batch.h"
+#include "cmu1_slide.h"
+#include "slide.h"
+#include <string.h>
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Field by field, request_t has padding
+static int same_request(request_t expected, request_t actual) {
+  return (expected.location.x == actual.location.x) &
+         (expected.location.y == actual.location.y) &
+         (expected.level == actual.level) & (expected.size.x == actual.size.x) &
+         (expected.size.y == actual.size.y) &
+         (memcmp(&expected.native, &actual.native, sizeof(native_t)) == 0);
+}
+
+int main(void) {
+  double scalings[4] = {1.0, 0.4997, 0.2495, 0.0625};
+  int levels[4] = {0, 0, 1, 2};
+  ipos_t size = {.x = 256, .y = 256};
+  int failures = 0;
+
+  for (int s = 0; s < 4; s++) {
+    native_level_t native_level = {
+        .level = levels[s],
+        .size = cmu1_dimensions[levels[s]],
+        .downsample = cmu1_downsamples[levels[s]],
+        .scaling = scalings[s] * cmu1_downsamples[levels[s]],
+    };
+    native_level.extra_pixels = native_level.scaling > 1
+                                    ? 3.0
+                                    : ceil(3 / native_level.scaling);
+
+    // Every location of a stride 7 grid, not a multiple of the vector size
+    ipos_t level_size = get_scaled_size(cmu1_dimensions[0], scalings[s]);
+    int64_t nx = (level_size.x - size.x) / 7, ny = 41;
+    request_batch_t batch;
+    if (request_batch_new(&batch, nx * ny + 3)) {
+      return 1;
+    }
+    for (int64_t i = 0; i < batch.n; i++) {
+      batch.x[i] = i % nx * 7;
+      batch.y[i] = i / nx * ((level_size.y - size.y) / ny);
+    }
+
+    double start = now();
+    native_region_requests_soa(&batch, size, native_level);
+    double elapsed = now() - start;
+
+    int64_t mismatches = 0;
+    for (int64_t i = 0; i < batch.n; i++) {
+      ipos_t location = {.x = batch.x[i], .y = batch.y[i]};
+      request_t expected = native_region_request(location, size, native_level);
+      mismatches += !same_request(expected, request_batch_get(&batch, i));
+    }
+    printf("scaling %f: %ld requests, %ld mismatches, %.1f M requests/s\n",
+           scalings[s], batch.n, mismatches, batch.n / elapsed * 1e-6);
+    failures += mismatches != 0;
+    request_batch_free(&batch);
+  }
+
+  // Whole tilings: same requests, same order. Overlap and roi chosen so the
+  // count isn't a multiple of the vector size, and the roi runs past the
+  // slide so some locations are filtered out.
+  level_props_t level_props = cmu1_level_props();
+  tiling_t tiling = {.scaling = 0.2495,
+                     .tile_size = size,
+                     .overlap = {17, 7},
+                     .roi_location = {9100, 6300},
+                     .roi_size = {3000, 2500}};
+  int64_t n;
+  request_t *requests = read_region_requests(tiling, NULL, level_props, &n);
+  request_batch_t batch;
+  int64_t n_batch = request_batch_tiling(&batch, tiling, NULL, level_props);
+  if (!requests || (n_batch < 0)) {
+    return 1;
+  }
+  int64_t mismatches = 0;
+  for (int64_t i = 0; i < MIN(n, n_batch); i++) {
+    mismatches += !same_request(requests[i], request_batch_get(&batch, i));
+  }
+  printf("tiling: %ld requests, %ld from the batch, %ld mismatches\n", n,
+         n_batch, mismatches);
+  failures += (n != n_batch) | (n % 4 == 0) | (mismatches != 0);
+  request_batch_free(&batch);
+  free(requests);
+
+  printf("failures: %d\n", failures);
+  return failures != 0;
+}
@@ -0,0 +1,67 @@
+// native_region_request_exact against dlup's requests.csv ( CMU-1.svs ), and
+// a case where the double version drifts.
+// usage: test-request-exact <requests.csv>
+#include "cmu1_slide.h"
+#include "slide.h"
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    return 1;
+  }
+  level_props_t cmu1 = cmu1_level_props();
+  int failures = 0;
+
+  FILE *fp = fopen(argv[1], "r");
+  if (!fp) {
+    return 1;
+  }
+  request_record_t r;
+  int64_t n = 0;
+  double max_diff = 0.0;
+  if (fscanf(fp, "%*[^\n]\n") == EOF) { // header
+    return 1;
+  }
+  while (fscanf(fp, "%ld,%ld,%lf,%ld,%ld,%ld,%ld,%d,%ld,%ld,%lf,%lf,%lf,%lf\n",
+                &r.location.x, &r.location.y, &r.scaling, &r.size.x,
+                &r.size.y, &r.request.location.x, &r.request.location.y,
+                &r.request.level, &r.request.size.x, &r.request.size.y,
+                &r.request.native.fractional_coordinates.x,
+                &r.request.native.fractional_coordinates.y,
+                &r.request.native.native_size.x,
+                &r.request.native.native_size.y) == 14) {
+    // Level as chosen by openslide for these rows
+    native_level_exact_t native_level = native_level_exact(
+        r.request.level, rational_from_double(r.scaling, 1000000), cmu1);
+    request_t e = native_region_request_exact(r.location, r.size, native_level);
+    failures += (e.location.x != r.request.location.x) |
+                (e.location.y != r.request.location.y) |
+                (e.size.x != r.request.size.x) | (e.size.y != r.request.size.y);
+    max_diff = MAX(max_diff, fabs(e.native.fractional_coordinates.x -
+                                  r.request.native.fractional_coordinates.x));
+    max_diff = MAX(max_diff, fabs(e.native.fractional_coordinates.y -
+                                  r.request.native.fractional_coordinates.y));
+    max_diff = MAX(max_diff, fabs(e.native.native_size.x -
+                                  r.request.native.native_size.x));
+    n++;
+  }
+  fclose(fp);
+  printf("rows    : %ld, max diff %g\n", n, max_diff);
+  failures += (n == 0) | (max_diff > 1e-9);
+
+  // 0.3 * 4 is a hair below 1.2 in doubles, so (620 + 256) / 1.2 = 730
+  // ceils to 731 and the double version reads one column too many
+  ipos_t dimensions[2] = {{40000, 40000}, {10000, 10000}};
+  level_props_t level_props = {.slide_size = dimensions[0],
+                               .level_count = 2,
+                               .level_dimensions = dimensions};
+  native_level_exact_t native_level =
+      native_level_exact(1, rational(3, 10), level_props);
+  ipos_t location = {.x = 620, .y = 0}, size = {.x = 256, .y = 256};
+  request_t e = native_region_request_exact(location, size, native_level);
+  // floor(620 / 1.2) - 3 = 513, ceil(876 / 1.2) + 3 = 733
+  printf("exact   : %ld, %ld\n", e.location.x, e.size.x);
+  failures += (e.location.x != 513 * 4) | (e.size.x != 733 - 513);
+
+  printf("failures: %d\n", failures);
+  return failures != 0;
+}
@@ -0,0 +1,101 @@
+// requests.csv -> binary index -> mmap, and a bad header is rejected.
+// usage: test-request-index <requests.csv> <scratch dir>
+#include "cmu1_slide.h"
+#include "index.h"
+#include "slide.h"
+#include <stddef.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    return 1;
+  }
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/requests.idx", argv[2]);
+  int failures = 0;
+
+  int64_t n = request_index_from_csv(path, argv[1]);
+  printf("records : %ld\n", n);
+  failures += n != 1408;
+
+  // Row 1 of requests.csv, straight from the mapping
+  request_index_t index;
+  failures += request_index_open(&index, path) != 0;
+  failures += index.count != n;
+  request_record_t *record = request_index_get(&index, 1);
+  failures += (record->location.x != 256) | (record->location.y != 0);
+  failures += (record->scaling != 0.2495) | (record->size.x != 256);
+  failures += (record->request.location.x != 1008) |
+              (record->request.level != 1) | (record->request.size.x != 267);
+  failures +=
+      fabs(record->request.native.fractional_coordinates.x - 4.5128889322) >
+      1e-9;
+  request_index_close(&index);
+
+  // Written in place, then cut short
+  failures += request_index_create(&index, path, 3) != 0;
+  for (int i = 0; i < 3; i++) {
+    request_index_get(&index, i)->location.x = i * 7;
+    request_index_get(&index, i)->request.level = i;
+  }
+  failures += request_index_truncate(&index, 2) != 0;
+  failures += request_index_close(&index) != 0;
+  failures += request_index_open(&index, path) != 0;
+  failures += (index.count != 2) | (index.records[1].location.x != 7) |
+              (index.records[1].request.level != 1);
+  request_index_close(&index);
+
+  // More records than size_t bytes: refused before the file is touched, and
+  // a header claiming them is rejected rather than wrapping around
+  failures += request_index_create(&index, path, INT64_MAX) == 0;
+  failures += request_index_open(&index, path) != 0;
+  request_index_close(&index);
+  int64_t count = INT64_MAX / 8;
+  FILE *fp = fopen(path, "r+");
+  fseek(fp, offsetof(request_index_header_t, count), SEEK_SET);
+  fwrite(&count, sizeof(count), 1, fp);
+  fclose(fp);
+  failures += request_index_open(&index, path) == 0;
+
+  // Straight from the batch API: the records read_region_records gives
+  level_props_t level_props = cmu1_level_props();
+  tiling_t tiling = {.scaling = 0.2495,
+                     .tile_size = {256, 256},
+                     .overlap = {32, 32},
+                     .roi_size = {4000, 3000}};
+  ipos_t grid_size = tiling_grid_size(tiling, level_props);
+  request_record_t *records =
+      malloc(grid_size.x * grid_size.y * sizeof(request_record_t));
+  int64_t n_records =
+      read_region_records(tiling, NULL, level_props, records);
+  n = request_index_write_tiling(path, tiling, NULL, level_props);
+  printf("tiling  : %ld\n", n);
+  failures += (n != n_records) | (n <= 0);
+  failures += request_index_open(&index, path) != 0;
+  failures += index.count != n_records;
+  for (int64_t i = 0; i < MIN(index.count, n_records); i++) {
+    request_record_t *a = &records[i], *b = request_index_get(&index, i);
+    failures += (a->location.x != b->location.x) |
+                (a->location.y != b->location.y) |
+                (a->scaling != b->scaling) | (a->size.x != b->size.x) |
+                (a->size.y != b->size.y) |
+                (a->request.location.x != b->request.location.x) |
+                (a->request.location.y != b->request.location.y) |
+                (a->request.level != b->request.level) |
+                (a->request.size.x != b->request.size.x) |
+                (memcmp(&a->request.native, &b->request.native,
+                        sizeof(native_t)) != 0);
+  }
+  request_index_close(&index);
+  free(records);
+
+  // Not an index
+  fp = fopen(path, "r+");
+  fputs("NOTANIDX", fp);
+  fclose(fp);
+  failures += request_index_open(&index, path) == 0;
+
+  remove(path);
+  printf("failures: %d\n", failures);
+  return failures != 0;
+}
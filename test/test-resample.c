@@ -0,0 +1,254 @@
+// SIMD resample kernels must be bit-exact with the scalar reference, and
+// cached coefficients with evaluated ones. Row streaming and threaded passes
+// must match the two-pass resample, and reduce-then-resample stay within
+// tolerance of it.
+#include "resize/resample.h"
+
+// Random image, deterministic
+Imaging random_image(const char *mode, int xsize, int ysize,
+                     unsigned int seed) {
+  Imaging im = ImagingNewDirty(mode, xsize, ysize);
+  srand(seed);
+  for (int y = 0; y < ysize; y++) {
+    for (int x = 0; x < xsize * 4; x++) {
+      im->image[y][x] = rand() & 0xff;
+    }
+  }
+  return im;
+}
+
+// Number of differing lines
+int compare(Imaging a, Imaging b) {
+  int diff = 0;
+  if ((a->xsize != b->xsize) | (a->ysize != b->ysize)) {
+    return 1;
+  }
+  for (int y = 0; y < a->ysize; y++) {
+    diff += memcmp(a->image[y], b->image[y], a->linesize) != 0;
+  }
+  return diff;
+}
+
+// Number of SIMD / cached results differing from scalar, for one mode
+int check_mode(const char *mode, int supported) {
+  int filters[] = {IMAGING_TRANSFORM_BOX, IMAGING_TRANSFORM_BILINEAR,
+                   IMAGING_TRANSFORM_BICUBIC, IMAGING_TRANSFORM_LANCZOS};
+  // in, out, box
+  int sizes[][2] = {{267, 256}, {261, 256}, {1031, 256}, {64, 203},
+                    {17, 5},    {5, 17},    {256, 256}};
+  float offsets[] = {0.0, 4.51, 4.02};
+  int failures = 0;
+
+  for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    int in = sizes[i][0], out = sizes[i][1];
+    Imaging imIn = random_image(mode, in, in + 3, i);
+    for (unsigned int f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+      for (unsigned int o = 0; o < sizeof(offsets) / sizeof(offsets[0]);
+           o++) {
+        float box[4] = {offsets[o], offsets[o] / 2, in - offsets[o],
+                        in + 3 - offsets[o] / 2};
+        ImagingResampleSetSIMD(RESAMPLE_SIMD_NONE);
+        ImagingResampleCoeffsSetCache(0);
+        Imaging reference =
+            ImagingResample(imIn, out, out + 1, filters[f], box);
+        ImagingResampleCoeffsSetCache(1);
+        for (int level = RESAMPLE_SIMD_NONE; level <= supported; level++) {
+          ImagingResampleSetSIMD(level);
+          Imaging imOut = ImagingResample(imIn, out, out + 1, filters[f], box);
+          int diff = compare(reference, imOut);
+          if (diff) {
+            printf("FAIL: %s, simd %d, %d -> %d, filter %d, offset %f: "
+                   "%d lines\n",
+                   mode, level, in, out, filters[f], offsets[o], diff);
+            failures += 1;
+          }
+          ImagingDelete(imOut);
+        }
+        ImagingDelete(reference);
+      }
+    }
+    ImagingDelete(imIn);
+  }
+  return failures;
+}
+
+// Output rows of a stream, into an image
+int stream_row(void *arg, int y, UINT8 *line) {
+  Imaging im = arg;
+  memcpy(im->image[y], line, im->linesize);
+  return 0;
+}
+
+// Row streaming against ImagingResample, one row pushed at a time
+int check_stream(const char *mode) {
+  int filters[] = {IMAGING_TRANSFORM_BILINEAR, IMAGING_TRANSFORM_LANCZOS};
+  int sizes[][2] = {{267, 256}, {1031, 256}, {64, 203}, {17, 5}, {256, 256}};
+  int failures = 0;
+  for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    int in = sizes[i][0], out = sizes[i][1];
+    Imaging imIn = random_image(mode, in, in + 3, i);
+    for (unsigned int f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+      float box[4] = {4.51, 2.25, in - 4.51, in + 3 - 2.25};
+      Imaging reference = ImagingResample(imIn, out, out + 1, filters[f], box);
+      Imaging imOut = ImagingNewDirty(reference->mode, out, out + 1);
+      ImagingResampleStream stream = ImagingResampleStreamNew(
+          mode, in, in + 3, out, out + 1, filters[f], box, stream_row, imOut);
+      for (int y = 0; y < in + 3; y++) {
+        ImagingResampleStreamPush(stream, (UINT8 *)imIn->image[y]);
+      }
+      int diff = !ImagingResampleStreamDone(stream) + compare(reference, imOut);
+      if (diff) {
+        printf("FAIL: stream %s, %d -> %d, filter %d: %d lines\n", mode, in,
+               out, filters[f], diff);
+        failures += 1;
+      }
+      // Ring of the vertical support, not the whole horizontal pass
+      failures += stream->ring_size > stream->vert->ksize;
+      ImagingResampleStreamDelete(stream);
+      ImagingDelete(imOut);
+      ImagingDelete(reference);
+    }
+    ImagingDelete(imIn);
+  }
+  return failures;
+}
+
+// Passes split over threads against the serial ones, big enough to split
+int check_threads(const char *mode) {
+  int sizes[][2] = {{1031, 256}, {700, 1024}, {2048, 2047}};
+  int failures = 0;
+  for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    int in = sizes[i][0], out = sizes[i][1];
+    Imaging imIn = random_image(mode, in, in + 3, i);
+    float box[4] = {4.51, 2.25, in - 4.51, in + 3 - 2.25};
+    ImagingResampleSetThreads(1);
+    Imaging reference =
+        ImagingResample(imIn, out, out + 1, IMAGING_TRANSFORM_LANCZOS, box);
+    for (int threads = 2; threads <= 5; threads += 3) {
+      ImagingResampleSetThreads(threads);
+      Imaging imOut =
+          ImagingResample(imIn, out, out + 1, IMAGING_TRANSFORM_LANCZOS, box);
+      int diff = compare(reference, imOut);
+      if (diff) {
+        printf("FAIL: %d threads, %s, %d -> %d: %d lines\n", threads, mode,
+               in, out, diff);
+        failures += 1;
+      }
+      ImagingDelete(imOut);
+    }
+    ImagingResampleSetThreads(1);
+    ImagingDelete(reference);
+    ImagingDelete(imIn);
+  }
+  return failures;
+}
+
+// Smooth image, like tissue more than noise: gradients, waves, some noise
+Imaging smooth_image(const char *mode, int xsize, int ysize,
+                     unsigned int seed) {
+  Imaging im = ImagingNewDirty(mode, xsize, ysize);
+  srand(seed);
+  for (int y = 0; y < ysize; y++) {
+    for (int x = 0; x < xsize; x++) {
+      for (int c = 0; c < 3; c++) {
+        double v = 128 + 60 * sin(x * (0.011 + c * 0.003)) +
+                   50 * cos(y * (0.017 - c * 0.004)) + (rand() % 16 - 8);
+        im->image[y][x * 4 + c] = v < 0 ? 0 : v > 255 ? 255 : v;
+      }
+      im->image[y][x * 4 + 3] = (char)255;
+    }
+  }
+  return im;
+}
+
+// SSE2 reduce kernels against the scalar one, partial edge cells included
+int check_reduce(int supported) {
+  int scales[][2] = {{2, 2}, {4, 4}, {3, 3}, {2, 4}};
+  int boxes[][4] = {{0, 0, 256, 256}, {3, 5, 250, 247}, {1, 2, 9, 7}};
+  int failures = 0;
+  Imaging imIn = random_image("BGRa", 259, 261, 7);
+  for (unsigned int s = 0; s < sizeof(scales) / sizeof(scales[0]); s++) {
+    for (unsigned int b = 0; b < sizeof(boxes) / sizeof(boxes[0]); b++) {
+      ImagingResampleSetSIMD(RESAMPLE_SIMD_NONE);
+      Imaging reference =
+          ImagingReduce(imIn, scales[s][0], scales[s][1], boxes[b]);
+      ImagingResampleSetSIMD(supported);
+      Imaging imOut = ImagingReduce(imIn, scales[s][0], scales[s][1], boxes[b]);
+      int diff = compare(reference, imOut);
+      if (diff) {
+        printf("FAIL: reduce %dx%d, box %d: %d lines\n", scales[s][0],
+               scales[s][1], b, diff);
+        failures += 1;
+      }
+      ImagingDelete(reference);
+      ImagingDelete(imOut);
+    }
+  }
+  ImagingDelete(imIn);
+  return failures;
+}
+
+// Reduce-then-resample against direct Lanczos: mean and max difference
+int check_reducing_gap(void) {
+  // in, out ( padded native regions of 256 px tiles )
+  int sizes[][2] = {{1064, 256}, {2096, 256}, {780, 256}, {4112, 256}};
+  double gaps[] = {2.0, 3.0};
+  int failures = 0;
+  for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    int in = sizes[i][0], out = sizes[i][1];
+    Imaging imIn = smooth_image("BGRa", in, in, i);
+    float extra = 3.0 * in / out;
+    float box[4] = {extra + 0.37, extra + 0.61, in - extra + 0.37,
+                    in - extra + 0.61};
+    ImagingResampleSetReducingGap(0.0);
+    Imaging reference =
+        ImagingResample(imIn, out, out, IMAGING_TRANSFORM_LANCZOS, box);
+    for (unsigned int g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++) {
+      ImagingResampleSetReducingGap(gaps[g]);
+      Imaging imOut =
+          ImagingResample(imIn, out, out, IMAGING_TRANSFORM_LANCZOS, box);
+      double total = 0;
+      int max = 0;
+      for (int y = 0; y < out; y++) {
+        for (int x = 0; x < out * 4; x++) {
+          int d = abs((UINT8)reference->image[y][x] - (UINT8)imOut->image[y][x]);
+          total += d;
+          max = d > max ? d : max;
+        }
+      }
+      double mean = total / (out * out * 4);
+      printf("reducing gap %.1f, %d -> %d: mean %.3f, max %d\n", gaps[g], in,
+             out, mean, max);
+      failures += (mean > 0.5) | (max > 4);
+      ImagingDelete(imOut);
+    }
+    ImagingResampleSetReducingGap(0.0);
+    ImagingDelete(reference);
+    ImagingDelete(imIn);
+  }
+  return failures;
+}
+
+int main(void) {
+  int supported = ImagingResampleSetSIMD(RESAMPLE_SIMD_AVX2);
+  printf("simd: %d\n", supported);
+
+  // BGRa is openslide ARGB, swizzled by the horizontal pass
+  int failures = check_mode("RGBA", supported);
+  failures += check_mode("BGRa", supported);
+  failures += check_stream("RGBA");
+  failures += check_stream("BGRa");
+  failures += check_threads("RGBA");
+  failures += check_threads("BGRa");
+  failures += check_reduce(supported);
+  failures += check_reducing_gap();
+
+  // Every level after the first reuses the coefficients
+  int64_t hits, misses;
+  ImagingResampleCoeffsStats(&hits, &misses);
+  printf("coefficients: %ld hits, %ld misses\n", hits, misses);
+  failures += (supported > RESAMPLE_SIMD_NONE) & (hits == 0);
+
+  printf("failures: %d\n", failures);
+  return failures != 0;
+}
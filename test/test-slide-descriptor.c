@@ -0,0 +1,94 @@
+// Cached slide descriptors: write / read roundtrip, and planning from one
+// without ever opening openslide.
+#include "cmu1_slide.h"
+#include "slide.h"
+#include <string.h>
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <cache dir>\n", argv[0]);
+    return 1;
+  }
+  const char *cache_dir = argv[1];
+
+  slide_descriptor_t descriptor = {
+      .quickhash = "0123456789abcdef",
+      .slide_props = {.mpp = 0.499,
+                      .magnification = 20,
+                      .size = cmu1_dimensions[0],
+                      .spacings = {0.499, 0.499},
+                      .offset = {0, 0},
+                      .bounds = cmu1_dimensions[0],
+                      .background = 0xffffff},
+      .level_props = cmu1_level_props(),
+  };
+  int failures = 0;
+
+  // Cached for this executable, any existing file will do
+  char *path = argv[0];
+  char cache_path[4096];
+  if (slide_descriptor_cache_path(cache_path, sizeof(cache_path), cache_dir,
+                                  path) ||
+      slide_descriptor_write(&descriptor, cache_path)) {
+    fprintf(stderr, "failed to write %s\n", cache_path);
+    return 1;
+  }
+
+  slide_descriptor_t read;
+  if (slide_descriptor_read(&read, cache_path)) {
+    fprintf(stderr, "failed to read %s\n", cache_path);
+    return 1;
+  }
+  failures += strcmp(read.quickhash, descriptor.quickhash) != 0;
+  failures += read.slide_props.mpp != descriptor.slide_props.mpp;
+  failures += read.slide_props.size.y != descriptor.slide_props.size.y;
+  failures += read.slide_props.background != descriptor.slide_props.background;
+  failures += read.level_props.level_count != 3;
+  for (int level = 0; level < 3; level++) {
+    failures += read.level_props.level_dimensions[level].x !=
+                cmu1_dimensions[level].x;
+    failures += read.level_props.level_dimensions[level].y !=
+                cmu1_dimensions[level].y;
+    failures +=
+        read.level_props.level_downsamples[level] != cmu1_downsamples[level];
+  }
+  free(read.level_props.level_dimensions);
+  free(read.level_props.level_downsamples);
+
+  // Same levels as openslide_get_best_level_for_downsample
+  double targets[6] = {0.5, 1.0, 3.9, cmu1_downsamples[1], 15.0, 64.0};
+  int expected_levels[6] = {0, 0, 0, 1, 1, 2};
+  for (int i = 0; i < 6; i++) {
+    int level = best_level_for_downsample(descriptor.level_props, targets[i]);
+    if (level != expected_levels[i]) {
+      fprintf(stderr, "downsample %f: level %d, expected %d\n", targets[i],
+              level, expected_levels[i]);
+      failures++;
+    }
+  }
+
+  // Lazy open: props from the descriptor, requests without openslide
+  oslide_t oslide = oslide_open_cached(path, cache_dir);
+  if (oslide.osr) {
+    fprintf(stderr, "slide was opened on a cache hit\n");
+    failures++;
+  }
+  failures += oslide.level_props.level_count != 3;
+  ipos_t location = {.x = 1000, .y = 2000}, size = {.x = 256, .y = 256};
+  descriptor.level_props.slide_size = descriptor.slide_props.size;
+  request_t expected = native_region_request(
+      location, size,
+      native_level_request(0.2495, NULL, descriptor.level_props));
+  request_t actual =
+      read_region_request(location, 0.2495, size, NULL, oslide.level_props);
+  failures += (actual.level != 1) | (actual.level != expected.level) |
+              (actual.location.x != expected.location.x) |
+              (actual.location.y != expected.location.y) |
+              (actual.size.x != expected.size.x) |
+              (actual.size.y != expected.size.y);
+  oslide_close(&oslide);
+
+  remove(cache_path);
+  printf("%d failures\n", failures);
+  return failures > 0;
+}
@@ -0,0 +1,168 @@
+// Tile cache: same output as uncached reads, hits on a 50% overlap tiling,
+// eviction under a small budget, LRU order, and non integral levels read
+// around the cache.
+// usage: test-tile-cache <dir>, synthetic slides are generated in <dir>
+#include "synthetic_slide.h"
+#include <inttypes.h>
+
+#define TILE_SIZE 128
+
+// Every request into its region, through oslide's cache if any
+static int read_tiles(oslide_t *oslide, request_t *requests, int64_t n,
+                      image_t *regions) {
+  for (int64_t i = 0; i < n; i++) {
+    if (oslide_read_region(oslide, &regions[i], requests[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static image_t *new_regions(int64_t n) {
+  image_t *regions = calloc(n, sizeof(image_t));
+  for (int64_t i = 0; i < n; i++) {
+    regions[i] = (image_t){.width = TILE_SIZE,
+                           .height = TILE_SIZE,
+                           .bands = 4,
+                           .data = malloc(TILE_SIZE * TILE_SIZE * 4)};
+  }
+  return regions;
+}
+
+static void free_regions(image_t *regions, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    free(regions[i].data);
+  }
+  free(regions);
+}
+
+// Regions that differ from expected
+static int compare_tiles(image_t *expected, image_t *actual, int64_t n) {
+  int failures = 0;
+  for (int64_t i = 0; i < n; i++) {
+    failures += memcmp(expected[i].data, actual[i].data,
+                       TILE_SIZE * TILE_SIZE * 4) != 0;
+  }
+  return failures;
+}
+
+// Tiles of a 50% overlap tiling at scaling, uncached then cached with
+// cache_bytes. Returns the cache stats of the cached pass, failures added.
+static tile_cache_stats_t cached_tiles(oslide_t *oslide, double scaling,
+                                       size_t cache_bytes, int *failures) {
+  tiling_t tiling = {.scaling = scaling,
+                     .tile_size = {TILE_SIZE, TILE_SIZE},
+                     .overlap = {TILE_SIZE / 2, TILE_SIZE / 2},
+                     .roi_size = {1024, 1024}};
+  int64_t n;
+  request_t *requests =
+      read_region_requests(tiling, oslide->osr, oslide->level_props, &n);
+  image_t *expected = new_regions(n), *actual = new_regions(n);
+
+  oslide_set_cache(oslide, 0);
+  *failures += read_tiles(oslide, requests, n, expected);
+  oslide_set_cache(oslide, cache_bytes);
+  *failures += read_tiles(oslide, requests, n, actual);
+  int differ = compare_tiles(expected, actual, n);
+  if (differ) {
+    fprintf(stderr,
+            "scaling %f: %d of %" PRId64 " tiles differ from uncached\n",
+            scaling, differ, n);
+  }
+  *failures += differ;
+
+  tile_cache_stats_t stats = oslide_cache_stats(oslide);
+  free_regions(expected, n);
+  free_regions(actual, n);
+  free(requests);
+  return stats;
+}
+
+static void print_stats(const char *name, tile_cache_stats_t stats) {
+  printf("%s: %" PRId64 " hits, %" PRId64 " misses, %" PRId64 " evictions\n",
+         name, stats.hits, stats.misses, stats.evictions);
+}
+
+// Block bx of row 0 of level 0, through cache, checked against openslide
+static int read_block(tile_cache_t *cache, openslide_t *osr, int bx,
+                      int block_size) {
+  size_t bytes = block_size * block_size * sizeof(uint32_t);
+  uint32_t *expected = malloc(bytes), *actual = malloc(bytes);
+  ipos_t origin = {.x = bx * block_size, .y = 0};
+  ipos_t size = {.x = block_size, .y = block_size};
+  openslide_read_region(osr, expected, origin.x, origin.y, 0, size.x, size.y);
+  tile_cache_read_region(cache, osr, actual, origin, 0, 1.0, size);
+  int failures = memcmp(expected, actual, bytes) != 0;
+  free(expected);
+  free(actual);
+  return failures;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <dir>\n", argv[0]);
+    return 1;
+  }
+  if (VIPS_INIT(argv[0])) {
+    return 1;
+  }
+  int failures = 0;
+
+  // Integral downsamples: level 1 is 2x
+  char path[4096];
+  oslide_t oslide;
+  if (synthetic_slide_open(&oslide, path, sizeof(path), argv[1], 4096)) {
+    return 1;
+  }
+  tile_cache_stats_t stats =
+      cached_tiles(&oslide, 0.5, 64 << 20, &failures);
+  print_stats("cached", stats);
+  // Each block decoded once, then shared by the tiles overlapping it
+  failures += (stats.misses != stats.blocks) | (stats.evictions != 0);
+  failures += stats.hits <= stats.misses;
+
+  // Room for 2 blocks: evictions, same output
+  size_t block_bytes =
+      TILE_CACHE_BLOCK_SIZE * TILE_CACHE_BLOCK_SIZE * sizeof(uint32_t);
+  stats = cached_tiles(&oslide, 0.5, 2 * block_bytes, &failures);
+  print_stats("small budget", stats);
+  failures += (stats.evictions == 0) | (stats.bytes > stats.max_bytes);
+  failures += stats.blocks > 2;
+
+  // LRU order: 0, 1, 0 ( hit ), 2 evicts 1, then 0 hits and 1 misses
+  int block_size = 64;
+  tile_cache_t *cache =
+      tile_cache_new(2 * block_size * block_size * sizeof(uint32_t), 64);
+  int order[6] = {0, 1, 0, 2, 0, 1};
+  for (int i = 0; i < 6; i++) {
+    failures += read_block(cache, oslide.osr, order[i], block_size);
+  }
+  stats = tile_cache_stats(cache);
+  print_stats("lru", stats);
+  failures += (stats.hits != 2) | (stats.misses != 4) |
+              (stats.evictions != 2) | (stats.blocks != 2);
+  tile_cache_free(cache);
+
+  // Blocks over budget are read, never kept
+  cache = tile_cache_new(1024, block_size);
+  failures += read_block(cache, oslide.osr, 0, block_size);
+  failures += read_block(cache, oslide.osr, 0, block_size);
+  stats = tile_cache_stats(cache);
+  failures += (stats.hits != 0) | (stats.misses != 2) | (stats.blocks != 0) |
+              (stats.bytes != 0);
+  tile_cache_free(cache);
+  oslide_close(&oslide);
+
+  // Non integral downsamples: level 1 is 3001 / 1500, read around the cache
+  if (synthetic_slide_open(&oslide, path, sizeof(path), argv[1], 3001)) {
+    return 1;
+  }
+  double downsample = oslide.level_props.level_downsamples[1];
+  failures += tile_cache_level_supported(downsample);
+  stats = cached_tiles(&oslide, 0.25, 64 << 20, &failures);
+  failures += (stats.hits != 0) | (stats.misses != 0);
+  oslide_close(&oslide);
+
+  printf("%d failures\n", failures);
+  return failures > 0;
+}
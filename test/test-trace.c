@@ -0,0 +1,120 @@
+// Read tracing, built with -DOSLIDE_TRACE: quarter octave bucketing, p50 /
+// p99 of oslide_trace_stats, reads counted per stage, and no trace at all
+// from code built without OSLIDE_TRACE ( trace_off.c ).
+// usage: test-trace <dir>, synthetic slides are generated in <dir>
+#include "synthetic_slide.h"
+#include <inttypes.h>
+
+#define TILE_SIZE 128
+#define TILES 16
+
+// trace_off.c
+int trace_off_expansions(void);
+void trace_off_spans(trace_t *trace);
+
+// Lower bound of the bucket of ns, as trace_percentile reports it
+static int64_t bucket_start(trace_t *trace, int64_t ns) {
+  trace_reset(trace);
+  trace_record(TRACE_DECODE, ns);
+  trace_stats_t stats = trace_stats(trace);
+  return trace_percentile(&stats.stages[TRACE_DECODE], 0.5);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <dir>\n", argv[0]);
+    return 1;
+  }
+  if (VIPS_INIT(argv[0])) {
+    return 1;
+  }
+  int failures = 0;
+
+  // Exact below 4 ns, then 4 buckets per octave starting at powers of 2
+  trace_t *trace = trace_new();
+  trace_set(trace);
+  struct {
+    int64_t ns, start;
+  } buckets[10] = {
+      {-5, 0}, {0, 0}, {3, 3},       {4, 4},          {7, 7},
+      {8, 8},  {9, 8}, {1000, 896}, {1024, 1024}, {1000000, 917504},
+  };
+  for (int i = 0; i < 10; i++) {
+    int64_t start = bucket_start(trace, buckets[i].ns);
+    if (start != buckets[i].start) {
+      fprintf(stderr,
+              "%" PRId64 " ns: bucket at %" PRId64 ", expected %" PRId64 "\n",
+              buckets[i].ns, start, buckets[i].start);
+      failures++;
+    }
+  }
+  // Within 25% everywhere, and ordered
+  int64_t previous = 0;
+  for (int64_t ns = 4; ns < ((int64_t)1 << 40); ns = ns * 9 / 8 + 1) {
+    int64_t start = bucket_start(trace, ns);
+    failures += (start > ns) | (ns - start > start / 4) | (start < previous);
+    previous = start;
+  }
+  // Past the last bucket: counted in it
+  trace_reset(trace);
+  trace_record(TRACE_DECODE, INT64_MAX);
+  trace_stats_t stats = trace_stats(trace);
+  failures += stats.stages[TRACE_DECODE].buckets[TRACE_BUCKETS - 1] != 1;
+  failures += stats.stages[TRACE_DECODE].max_ns != INT64_MAX;
+  trace_set(NULL);
+  trace_free(trace);
+
+  char path[4096];
+  oslide_t oslide;
+  if (synthetic_slide_open(&oslide, path, sizeof(path), argv[1], 2048)) {
+    return 1;
+  }
+
+  // Every read counted once, decodes included
+  ipos_t size = {.x = TILE_SIZE, .y = TILE_SIZE};
+  image_t region = {.width = TILE_SIZE,
+                    .height = TILE_SIZE,
+                    .bands = 4,
+                    .data = malloc(TILE_SIZE * TILE_SIZE * sizeof(uint32_t))};
+  for (int i = 0; i < TILES; i++) {
+    ipos_t location = {.x = i % 4 * TILE_SIZE, .y = i / 4 * TILE_SIZE};
+    request_t request = read_region_request(location, 0.5, size, oslide.osr,
+                                            oslide.level_props);
+    failures += oslide_read_region(&oslide, &region, request);
+  }
+  stats = oslide_trace_stats(&oslide);
+  oslide_trace_dump(&oslide, stdout);
+  trace_histogram_t *reads = &stats.stages[TRACE_READ_REGION];
+  failures += (reads->count != TILES) |
+              (stats.stages[TRACE_DECODE].count < TILES);
+  failures += (trace_percentile(reads, 0.5) > trace_percentile(reads, 0.99)) |
+              (trace_percentile(reads, 0.99) > reads->max_ns);
+
+  // Known spans: 98 at 1 us, 2 at 1 ms. p99 is the 99th of 100
+  oslide_trace_reset(&oslide);
+  trace_set(oslide.trace);
+  for (int i = 0; i < 100; i++) {
+    trace_record(TRACE_RESIZE, i < 98 ? 1000 : 1000000);
+  }
+  stats = oslide_trace_stats(&oslide);
+  trace_histogram_t *resizes = &stats.stages[TRACE_RESIZE];
+  printf("p50 %" PRId64 " ns, p99 %" PRId64 " ns\n",
+         trace_percentile(resizes, 0.5), trace_percentile(resizes, 0.99));
+  failures += (resizes->count != 100) | (resizes->max_ns != 1000000) |
+              (resizes->total_ns != 98 * 1000 + 2 * 1000000);
+  failures += (trace_percentile(resizes, 0.5) != 896) |
+              (trace_percentile(resizes, 0.99) != 917504);
+  failures += stats.stages[TRACE_READ_REGION].count != 0;
+
+  // Without OSLIDE_TRACE: nothing expanded, nothing recorded
+  failures += trace_off_expansions() != 0;
+  trace_off_spans(oslide.trace);
+  stats = oslide_trace_stats(&oslide);
+  failures += stats.stages[TRACE_DECODE].count != 0;
+  trace_set(NULL);
+
+  free(region.data);
+  oslide_close(&oslide);
+  printf("%d failures\n", failures);
+  return failures > 0;
+}
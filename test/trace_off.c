@@ -0,0 +1,28 @@
+// Instrumentation with tracing off, for test-trace: every TRACE_* macro
+// expands to nothing, so spans neither exist nor record.
+#undef OSLIDE_TRACE
+#include "trace.h"
+#include <string.h>
+
+#define STRINGIFY(x) #x
+#define EXPANDED(x) STRINGIFY(x)
+
+int trace_off_expansions(void) {
+  return strlen(EXPANDED(TRACE_BEGIN(span))) +
+         strlen(EXPANDED(TRACE_END(span, TRACE_DECODE))) +
+         strlen(EXPANDED(TRACE_BIND(trace, previous))) +
+         strlen(EXPANDED(TRACE_UNBIND(previous)));
+}
+
+// Spans around nothing. Names are free again after each macro, which would
+// not compile if TRACE_BEGIN or TRACE_BIND declared them.
+void trace_off_spans(trace_t *trace) {
+  TRACE_BIND(trace, previous);
+  TRACE_BEGIN(span);
+  TRACE_END(span, TRACE_DECODE);
+  TRACE_UNBIND(previous);
+  int64_t span = 0;
+  trace_t *previous = trace;
+  (void)span;
+  (void)previous;
+}